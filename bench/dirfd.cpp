@@ -0,0 +1,81 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Benchmark opening files by full path against opening them by name
+ *        through a dir_cache, on a deep synthetic tree.
+ *
+ * Usage: bench_dirfd [depth] [fanout] [files per directory] [directory]
+ *
+ * A tree of the given depth and fanout is built under the directory
+ * (a temporary one by default, removed afterwards), with small files in
+ * every leaf directory. Every file is then opened, its first bytes read,
+ * and closed, once by path and once through a dir_cache, in the order
+ * a size group would visit them: spread over the tree. The page cache
+ * is warm for both, so the difference is the path resolution.
+ */
+
+#include <print>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dircache.hpp"
+
+namespace fs = std::filesystem;
+
+int main(int argc, char *argv[])
+{
+    const unsigned depth  = argc > 1 ? std::stoul(argv[1]) : 12;
+    const unsigned fanout = argc > 2 ? std::stoul(argv[2]) : 3;
+    const unsigned files  = argc > 3 ? std::stoul(argv[3]) : 8;
+    const bool own_dir = argc <= 4;
+    const fs::path root = own_dir ? fs::temp_directory_path() / "dfs-bench-dirfd" : fs::path(argv[4]);
+
+    std::vector<std::string> paths;
+    // A chain of single directories, branching only on the last levels,
+    // so that the tree is deep without being huge.
+    const unsigned branching = std::min(depth, 6u);
+    std::vector<fs::path> level{root};
+    for (unsigned d=0; d<depth; d++) {
+        std::vector<fs::path> next;
+        for (const auto& dir: level)
+            for (unsigned i=0; i<(d+branching >= depth ? fanout : 1); i++)
+                next.push_back(dir / std::format("d{}", i));
+        level = std::move(next);
+    }
+    for (const auto& dir: level) {
+        fs::create_directories(dir);
+        for (unsigned i=0; i<files; i++) {
+            auto p = (dir / std::format("f{}", i)).generic_string();
+            std::ofstream(p) << p;
+            paths.push_back(std::move(p));
+        }
+    }
+    std::ranges::shuffle(paths, std::mt19937_64{42});
+    const auto budget = dfs::dir_cache::default_budget();
+    std::println("{} files in {} directories at depth {}, {} kept open",
+                 paths.size(), level.size(), depth, budget);
+
+    auto run = [&](const char *name, auto&& open) {
+        char buf[64];
+        std::size_t bytes = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (int round=0; round<5; round++)
+            for (const auto& p: paths) {
+                auto f = open(p);
+                bytes += f.read(buf, sizeof buf);
+            }
+        const std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        std::println("{:<10} {:8.3f} us/open  ({} bytes read)", name, t.count() * 1e6 / (5 * paths.size()), bytes);
+    };
+
+    run("by path", [](const std::string& p) { return dfs::input_file(p); });
+    dfs::dir_cache dirs(budget);
+    run("dir_cache", [&](const std::string& p) { return dfs::input_file(p, &dirs); });
+
+    if (own_dir)
+        fs::remove_all(root);
+}
@@ -0,0 +1,81 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Benchmark sorting paths with std::sort against dfs::radix::sort.
+ *
+ * Usage: bench_pathsort [directory | number of paths] [threads]
+ *
+ * The paths are those of the files under the directory, or as many
+ * synthetic ones as asked (2 million by default), shaped like a source
+ * tree: a few roots, deep directories and numbered files, so that they
+ * share long prefixes. Every sort starts from the same shuffled order,
+ * and the radix sorts are checked against std::sort.
+ */
+
+#include <print>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "radix.hpp"
+
+namespace fs = std::filesystem;
+
+std::vector<std::string> synthetic(std::size_t n)
+{
+    constexpr std::string_view roots[] {"/home/user/projects/", "/srv/data/archive/", "/var/lib/containers/storage/overlay/"};
+    constexpr std::string_view parts[] {"src", "include", "lib", "test", "build", "docs", "vendor", "internal",
+                                        "common", "util", "core", "net", "io", "v1", "v2", "assets"};
+    std::mt19937_64 rng(7);
+    std::vector<std::string> paths;
+    paths.reserve(n);
+    while (paths.size() < n) {
+        std::string dir(roots[rng() % std::size(roots)]);
+        dir += std::format("project{:03}/", rng() % 200);
+        for (auto depth = 2 + rng() % 6; depth; depth--)
+            dir += std::format("{}/", parts[rng() % std::size(parts)]);
+        for (auto files = 1 + rng() % 40; files && paths.size() < n; files--)
+            paths.push_back(std::format("{}file_{:04}.{}", dir, rng() % 10000, rng() % 2 ? "cpp" : "hpp"));
+    }
+    return paths;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> paths;
+    if (argc > 1 && fs::is_directory(argv[1])) {
+        for (const auto& entry: fs::recursive_directory_iterator{argv[1], fs::directory_options::skip_permission_denied})
+            if (entry.is_regular_file())
+                paths.push_back(entry.path().generic_string());
+    }
+    else
+        paths = synthetic(argc > 1 ? std::stoul(argv[1]) : 2'000'000);
+    const unsigned threads = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::ranges::shuffle(paths, std::mt19937_64{42});
+    std::size_t bytes = 0;
+    for (const auto& p: paths)
+        bytes += p.size();
+    std::println("{} paths, {:.1f} bytes on average", paths.size(), double(bytes) / std::max<std::size_t>(paths.size(), 1));
+
+    std::vector<std::string> expected;
+    auto run = [&](const char *name, auto&& sort) {
+        auto v = paths;
+        const auto start = std::chrono::steady_clock::now();
+        sort(v);
+        const std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+        const char *check = "";
+        if (expected.empty())
+            expected = std::move(v);
+        else if (v != expected)
+            check = "  WRONG ORDER";
+        std::println("{:<22} {:8.3f} s{}", name, t.count(), check);
+    };
+
+    run("std::sort", [](auto& v) { std::ranges::sort(v); });
+    run("radix, 1 thread", [](auto& v) { dfs::radix::sort(v, {}, 1); });
+    run(std::format("radix, {} threads", threads).c_str(), [&](auto& v) { dfs::radix::sort(v, {}, threads); });
+}
@@ -0,0 +1,462 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Persistent cache of full-content digests between runs.
+ *
+ * An entry is valid while the file keeps the cached size and mtime.
+ * Large files also keep a snapshot of the hash state at their cached length,
+ * so a file that only grew since can be hashed from there on:
+ * the snapshot is trusted if the last block before that length still hashes
+ * to the saved value.
+ * Large files may also keep the digests of their blocks of block_size bytes,
+ * against which a new file of the same size is compared block by block.
+ *
+ * Several processes may share one cache while they run.
+ * New entries are appended to a log beside the cache file in batches,
+ * of batch_size entries or of what was stored within tail_interval,
+ * and a process that misses an entry reads what the others appended since.
+ * Saving, or a log grown past compact_size, folds the log into the cache
+ * file and starts a new log generation, which tells the other processes
+ * to reload the cache file. All of this happens under a lock file.
+ *
+ * Cache file layout (little-endian):
+ *   header, front-coded sorted paths padded to 8 bytes,
+ *   then for every path a record, followed by a snapshot if it has one
+ *   and by its block digests.
+ * Log layout:
+ *   log header, then log records, each followed by its path, its snapshot
+ *   if it has one, its block digests, and an xxh3-64 of all that.
+ *   A torn record ends the log.
+ *
+ * Lookups and stores may come from several hashing threads at once.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <print>
+#include <ranges>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "xxhash.hpp"
+#include "filelock.hpp"
+#include "frontcode.hpp"
+#include "index.hpp"
+#include "radix.hpp"
+
+namespace dfs
+{
+
+class hash_cache
+{
+public:
+    static constexpr std::uint64_t snapshot_min_size = 1<<20; // 1 MiB
+    static constexpr std::uint64_t tail_size = 1<<12;         // 4 KiB
+    static constexpr std::uint64_t block_size = 1<<20;        // 1 MiB
+
+    struct snapshot {
+        std::array<std::uint8_t, xxh::hash3_state128_t::serialized_size> state;
+        std::uint64_t tail_hash; // xxh3-64 of the last tail_size bytes
+    };
+
+    struct entry {
+        std::uint64_t size;
+        std::int64_t mtime;
+        xxh::hash128_t digest;
+        std::optional<snapshot> snap;
+        std::vector<std::uint64_t> blocks; // xxh3-64 of every block, if kept
+    };
+
+private:
+    static constexpr char magic[8] {'D','F','S','C','A','C','H','E'};
+    static constexpr char log_magic[8] {'D','F','S','C','L','O','G','3'};
+    static constexpr std::uint32_t version = 3; // digests of 1 and 2 may be wrong
+    static constexpr std::uint64_t compact_size = 1<<26;         // 64 MiB of log
+    static constexpr auto tail_interval = std::chrono::milliseconds(200);
+    static constexpr std::size_t batch_size = 256; // entries appended at once
+
+    struct header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t reserved;
+        std::uint64_t count;
+        std::uint64_t paths_size;
+    };
+
+    struct record {
+        std::uint64_t size;
+        std::int64_t mtime;
+        std::uint64_t digest_low, digest_high;
+        std::uint32_t has_snapshot;
+        std::uint32_t block_count;
+    };
+
+    struct log_header {
+        char magic[8];
+        std::uint64_t generation;
+    };
+
+    struct log_record {
+        std::uint32_t path_size;
+        std::uint32_t reserved;
+        record r;
+    };
+
+    std::filesystem::path file_, log_file_;
+    file_lock lock_;
+    std::unordered_map<std::string, entry> map_;
+    std::mutex mutex_;
+    std::uint64_t generation_ = 0; // of the log read so far, 0 before any
+    std::uint64_t offset_ = 0;     // end of the log read so far, 0 if none
+    std::chrono::steady_clock::time_point last_tail_;
+    std::vector<std::pair<std::string, entry>> pending_; // stored, not yet in the log
+    std::chrono::steady_clock::time_point last_flush_;
+
+    static constexpr std::uint32_t max_blocks = 1<<24;
+
+    /**
+     * @brief The bytes of the snapshot and block digests after @p r.
+     */
+    static std::size_t extra_bytes(const record& r)
+    {
+        return (r.has_snapshot ? sizeof(snapshot::state) + sizeof(snapshot::tail_hash) : 0)
+             + r.block_count * sizeof(std::uint64_t);
+    }
+
+    static record to_record(const entry& e)
+    {
+        return {e.size, e.mtime, e.digest.low64, e.digest.high64, e.snap.has_value(),
+                static_cast<std::uint32_t>(e.blocks.size())};
+    }
+
+    /**
+     * @brief Append the snapshot and block digests of @p e to @p out.
+     */
+    static void put_extra(std::string& out, const entry& e)
+    {
+        if (e.snap) {
+            out.append(reinterpret_cast<const char*>(e.snap->state.data()), e.snap->state.size());
+            out.append(reinterpret_cast<const char*>(&e.snap->tail_hash), sizeof e.snap->tail_hash);
+        }
+        out.append(reinterpret_cast<const char*>(e.blocks.data()), e.blocks.size() * sizeof(std::uint64_t));
+    }
+
+    /**
+     * @brief The entry of @p r, with its snapshot and block digests from @p p.
+     */
+    static entry from_record(const record& r, const char *p)
+    {
+        entry e{r.size, r.mtime, {r.digest_low, r.digest_high}, std::nullopt, {}};
+        if (r.has_snapshot) {
+            e.snap.emplace();
+            std::memcpy(e.snap->state.data(), p, e.snap->state.size());
+            std::memcpy(&e.snap->tail_hash, p + e.snap->state.size(), sizeof e.snap->tail_hash);
+            p += sizeof(snapshot::state) + sizeof(snapshot::tail_hash);
+        }
+        e.blocks.resize(r.block_count);
+        std::memcpy(e.blocks.data(), p, r.block_count * sizeof(std::uint64_t));
+        return e;
+    }
+
+    void load()
+    {
+        std::ifstream in(file_, std::ios_base::binary);
+        if (!in)
+            return;
+
+        header h;
+        if (!in.read(reinterpret_cast<char*>(&h), sizeof h)
+         || std::memcmp(h.magic, magic, sizeof magic) != 0 || h.version != version)
+            throw std::runtime_error("not a cache file of this version");
+
+        std::vector<char> paths((h.paths_size + 7) & ~std::uint64_t(7));
+        if (!in.read(paths.data(), paths.size()))
+            throw std::runtime_error("truncated");
+        frontcode::view names({paths.data(), h.paths_size});
+        if (names.size() != h.count)
+            throw std::runtime_error("inconsistent");
+
+        std::vector<char> extra;
+        names.for_each([&](auto, const std::string& path) {
+            record r;
+            if (!in.read(reinterpret_cast<char*>(&r), sizeof r))
+                throw std::runtime_error("truncated");
+            if (r.block_count > max_blocks)
+                throw std::runtime_error("inconsistent");
+            extra.resize(extra_bytes(r));
+            if (!in.read(extra.data(), extra.size()))
+                throw std::runtime_error("truncated");
+            map_.insert_or_assign(path, from_record(r, extra.data()));
+        });
+    }
+
+    /**
+     * @brief Load the cache file, only reporting a damaged one.
+     */
+    void try_load()
+    {
+        try { load(); }
+        catch (const std::exception& e) {
+            std::println(stderr, "Ignoring cache {}: {}", file_.string(), e.what());
+        }
+    }
+
+    /**
+     * @brief Read what was appended to the log since the last call.
+     *
+     * Must be called under the file lock.
+     */
+    void read_log()
+    {
+        std::ifstream in(log_file_, std::ios_base::binary);
+        log_header h;
+        if (!in.read(reinterpret_cast<char*>(&h), sizeof h)
+         || std::memcmp(h.magic, log_magic, sizeof log_magic) != 0)
+        {
+            offset_ = 0;
+            return;
+        }
+        if (h.generation != generation_) {
+            // Compacted by another process: the cache file has it all now.
+            if (generation_)
+                try_load();
+            generation_ = h.generation;
+            offset_ = sizeof h;
+        }
+
+        in.seekg(offset_);
+        std::string bytes;
+        for (log_record lr; in.read(reinterpret_cast<char*>(&lr), sizeof lr); )
+        {
+            if (lr.path_size > (1<<16) || lr.r.block_count > max_blocks)
+                break;
+            bytes.assign(reinterpret_cast<const char*>(&lr), sizeof lr);
+            bytes.resize(sizeof lr + lr.path_size + extra_bytes(lr.r));
+            std::uint64_t check;
+            if (!in.read(bytes.data() + sizeof lr, bytes.size() - sizeof lr)
+             || !in.read(reinterpret_cast<char*>(&check), sizeof check)
+             || xxh::xxhash3<64>(bytes.data(), bytes.size()) != check)
+                break;
+
+            map_.insert_or_assign(bytes.substr(sizeof lr, lr.path_size),
+                                  from_record(lr.r, bytes.data() + sizeof lr + lr.path_size));
+            offset_ += bytes.size() + sizeof check;
+        }
+    }
+
+    /**
+     * @brief Start a new, empty log generation. Must hold the file lock.
+     */
+    void reset_log()
+    {
+        log_header h;
+        std::memcpy(h.magic, log_magic, sizeof log_magic);
+        h.generation = std::max<std::uint64_t>(generation_ + 1,
+            std::chrono::system_clock::now().time_since_epoch().count());
+        std::ofstream out(log_file_, std::ios_base::binary | std::ios_base::trunc);
+        out.write(reinterpret_cast<const char*>(&h), sizeof h);
+        if (!out)
+            throw std::runtime_error("Cannot write cache log: " + log_file_.string());
+        generation_ = h.generation;
+        offset_ = sizeof h;
+    }
+
+    /**
+     * @brief Read the log as read_log does, keeping the pending entries
+     *        over what other processes appended for the same paths.
+     */
+    void read_log_pending()
+    {
+        read_log();
+        for (const auto& [path, e]: pending_)
+            map_.insert_or_assign(path, e);
+    }
+
+    /**
+     * @brief Append the pending entries to the log in one write. Must hold
+     *        the file lock, with the log read to its end.
+     */
+    void append_pending()
+    {
+        if (pending_.empty())
+            return;
+        if (offset_ == 0)
+            reset_log();
+        else if (std::filesystem::file_size(log_file_) != offset_)
+            std::filesystem::resize_file(log_file_, offset_); // drop a torn record
+
+        std::string bytes, all;
+        for (const auto& [path, e]: pending_) {
+            log_record lr{static_cast<std::uint32_t>(path.size()), 0, to_record(e)};
+            bytes.assign(reinterpret_cast<const char*>(&lr), sizeof lr);
+            bytes += path;
+            put_extra(bytes, e);
+            const std::uint64_t check = xxh::xxhash3<64>(bytes.data(), bytes.size());
+            bytes.append(reinterpret_cast<const char*>(&check), sizeof check);
+            all += bytes;
+        }
+
+        std::ofstream out(log_file_, std::ios_base::binary | std::ios_base::app);
+        out.write(all.data(), all.size());
+        if (!out)
+            throw std::runtime_error("Cannot write cache log: " + log_file_.string());
+        offset_ += all.size();
+        pending_.clear();
+    }
+
+    /**
+     * @brief Append the pending entries under the file lock,
+     *        and compact the log if it grew too long. Must hold the mutex.
+     */
+    void flush()
+    {
+        last_flush_ = std::chrono::steady_clock::now();
+        if (pending_.empty())
+            return;
+        std::lock_guard flock(lock_);
+        read_log_pending();
+        append_pending();
+        if (offset_ >= compact_size)
+            compact();
+    }
+
+    /**
+     * @brief Write all entries to the cache file, replacing it atomically,
+     *        and empty the log. Must hold the file lock.
+     */
+    void compact()
+    {
+        std::vector<const std::pair<const std::string, entry>*> items;
+        items.reserve(map_.size());
+        for (const auto& item: map_)
+            items.push_back(&item);
+        radix::sort(items, [](auto p) -> const std::string& { return p->first; });
+
+        auto paths = frontcode::encode(items | std::views::transform(
+            [](auto p) -> std::string_view { return p->first; }));
+        header h{};
+        std::memcpy(h.magic, magic, sizeof magic);
+        h.version = version;
+        h.count = items.size();
+        h.paths_size = paths.size();
+        paths.resize((paths.size() + 7) & ~std::size_t(7));
+
+        auto tmp = file_;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios_base::binary | std::ios_base::trunc);
+            out.write(reinterpret_cast<const char*>(&h), sizeof h);
+            out.write(paths.data(), paths.size());
+            std::string bytes;
+            for (auto p: items) {
+                const auto r = to_record(p->second);
+                bytes.assign(reinterpret_cast<const char*>(&r), sizeof r);
+                put_extra(bytes, p->second);
+                out.write(bytes.data(), bytes.size());
+            }
+            if (!out)
+                throw std::runtime_error("Cannot write cache: " + tmp.string());
+        }
+        std::filesystem::rename(tmp, file_);
+        reset_log();
+    }
+
+    static std::filesystem::path beside(std::filesystem::path file, const char *ext)
+    {
+        file += ext;
+        return file;
+    }
+
+public:
+    /**
+     * @brief Load the cache from @p file and its log if they exist.
+     *
+     * A damaged cache is only reported and then started afresh.
+     */
+    explicit hash_cache(std::filesystem::path file)
+        : file_(std::move(file)), log_file_(beside(file_, ".log")), lock_(beside(file_, ".lock"))
+    {
+        std::shared_lock lock(lock_);
+        try_load();
+        read_log();
+        last_tail_ = last_flush_ = std::chrono::steady_clock::now();
+    }
+
+    hash_cache(const hash_cache&) = delete;
+    hash_cache& operator=(const hash_cache&) = delete;
+
+    /**
+     * @brief Append what is still pending to the log, if it can be.
+     */
+    ~hash_cache()
+    {
+        try {
+            std::lock_guard lock(mutex_);
+            flush();
+        }
+        catch (const std::exception& e) {
+            std::println(stderr, "Cannot write cache {}: {}", file_.string(), e.what());
+        }
+    }
+
+    /**
+     * @brief Look up @p path, also among what other processes appended
+     *        since the last look, at most once every tail_interval.
+     */
+    std::optional<entry> find(const std::string& path)
+    {
+        auto key = index::normalize_path(path);
+        std::lock_guard lock(mutex_);
+        auto it = map_.find(key);
+        if (it == map_.end())
+            if (auto now = std::chrono::steady_clock::now(); now - last_tail_ >= tail_interval)
+            {
+                last_tail_ = now;
+                std::shared_lock flock(lock_);
+                read_log_pending();
+                it = map_.find(key);
+            }
+        return it == map_.end() ? std::nullopt : std::optional(it->second);
+    }
+
+    /**
+     * @brief Add or replace the entry of @p path, visible to other processes
+     *        once its batch is appended to the log.
+     */
+    void store(const std::string& path, entry e)
+    {
+        auto key = index::normalize_path(path);
+        std::lock_guard lock(mutex_);
+        pending_.emplace_back(key, e);
+        map_.insert_or_assign(std::move(key), std::move(e));
+        if (pending_.size() >= batch_size || std::chrono::steady_clock::now() - last_flush_ >= tail_interval)
+            flush();
+    }
+
+    /**
+     * @brief Fold the log into the cache file, unless both are up to date.
+     */
+    void save()
+    {
+        std::lock_guard lock(mutex_);
+        std::lock_guard flock(lock_);
+        read_log_pending();
+        append_pending();
+        if (offset_ > sizeof(log_header) || !std::filesystem::exists(file_))
+            compact();
+    }
+};
+
+} // namespace dfs
@@ -0,0 +1,73 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Recognize files in content-addressed stores by their paths.
+ *
+ * A pattern is an ECMAScript regular expression searched in the generic
+ * path, whose first capture group is the digest embedded in it.
+ * Files of the same size with the same embedded digest, from the same
+ * pattern, are taken to be equal without reading them.
+ *
+ * Git loose objects are not among the built-in patterns: they are named
+ * after the uncompressed object, so two of them may hold the same object
+ * compressed differently, and their bytes are not what the name says.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dfs::cas
+{
+
+inline constexpr std::string_view builtins[] {
+    // OCI image layouts, containerd and docker content stores
+    R"(/blobs/(sha256/[0-9a-f]{64}|sha384/[0-9a-f]{96}|sha512/[0-9a-f]{128})$)",
+    // Hugging Face hub cache
+    R"(/blobs/([0-9a-f]{40}|[0-9a-f]{64})$)",
+    // Bazel disk cache
+    R"(/cas/[0-9a-f]{2}/([0-9a-f]{64})$)",
+    // pnpm store
+    R"(/files/([0-9a-f]{2}/[0-9a-f]{126})(-exec)?$)",
+};
+
+class matcher
+{
+    std::vector<std::regex> patterns_;
+
+public:
+    /**
+     * @throw std::regex_error if @p regex is not valid.
+     */
+    void add(std::string_view regex)
+    {
+        patterns_.emplace_back(regex.begin(), regex.end(), std::regex::optimize);
+    }
+
+    void add_builtins()
+    {
+        for (const auto regex: builtins)
+            add(regex);
+    }
+
+    bool empty() const noexcept { return patterns_.empty(); }
+
+    struct match {
+        std::string key; // the pattern's number and the embedded digest
+    };
+
+    std::optional<match> find(const std::string& path) const
+    {
+        std::smatch m;
+        for (std::size_t i=0; i<patterns_.size(); i++)
+            if (std::regex_search(path, m, patterns_[i]) && m.size() > 1 && m[1].matched)
+                return match{std::to_string(i) + ':' + m[1].str()};
+        return std::nullopt;
+    }
+};
+
+} // namespace dfs::cas
@@ -0,0 +1,175 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Find where small files may start inside large ones, in one pass.
+ *
+ * Every small file is keyed by a rolling hash (Rabin-Karp) of its first
+ * window of bytes, and all the keys go into one table. A large file is
+ * then read once, rolling the hash over every window of it: a window
+ * whose hash is in the table is where one of those small files may start,
+ * to be confirmed by its digest. A bitset in front of the table answers
+ * most lookups without touching it.
+ *
+ * The hash is a polynomial in an odd multiplier, modulo 2^64, of the
+ * bytes mapped to random words. Unlike a hash by rotations and XOR,
+ * whose rotations repeat every 64 bytes, it does not cancel out over
+ * periodic data such as patterned fill: windows of different patterns
+ * get different hashes, not all the same one.
+ *
+ * A file and the span of a larger one where it may be are both hashed
+ * by span_digest, so that they are read and hashed the same way.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "xxhash.hpp"
+
+namespace dfs::contain
+{
+
+inline constexpr std::size_t window = 1<<12; // 4 KiB
+
+namespace detail
+{
+    inline constexpr auto bytes = [] {
+        std::array<std::uint64_t, 256> t{};
+        std::uint64_t x = 0x243f6a8885a308d3; // splitmix64
+        for (auto& v: t) {
+            std::uint64_t z = (x += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            v = z ^ (z >> 31);
+        }
+        return t;
+    }();
+
+    inline constexpr std::uint64_t base = 0x9e3779b97f4a7c15; // odd
+
+    // base to the power window, the weight of a byte leaving the window
+    inline constexpr std::uint64_t base_window = [] {
+        std::uint64_t r = 1;
+        for (std::size_t i=0; i<window; i++)
+            r *= base;
+        return r;
+    }();
+}
+
+/**
+ * @brief The hash of the window bytes at @p p.
+ */
+inline std::uint64_t hash(const unsigned char *p)
+{
+    std::uint64_t h = 0;
+    for (std::size_t i=0; i<window; i++)
+        h = h * detail::base + detail::bytes[p[i]];
+    return h;
+}
+
+/**
+ * @brief The hash of the window one byte on, @p out leaving and @p in entering.
+ */
+inline std::uint64_t roll(std::uint64_t h, unsigned char out, unsigned char in)
+{
+    return h * detail::base + detail::bytes[in] - detail::bytes[out] * detail::base_window;
+}
+
+/**
+ * @brief The window hashes of many patterns, each with an id.
+ */
+class table
+{
+    static constexpr unsigned filter_bits = 24;
+    std::vector<std::uint64_t> filter_ = std::vector<std::uint64_t>((1u << filter_bits) / 64);
+    std::unordered_multimap<std::uint64_t, std::uint32_t> ids_;
+
+    static std::size_t bit(std::uint64_t h) noexcept { return h >> (64 - filter_bits); }
+
+public:
+    void add(std::uint64_t h, std::uint32_t id)
+    {
+        filter_[bit(h) / 64] |= std::uint64_t(1) << bit(h) % 64;
+        ids_.emplace(h, id);
+    }
+
+    bool empty() const noexcept { return ids_.empty(); }
+
+    /**
+     * @brief Call @p f(id) for every pattern of hash @p h.
+     */
+    template <class F>
+    void find(std::uint64_t h, F&& f) const
+    {
+        if (!(filter_[bit(h) / 64] >> bit(h) % 64 & 1))
+            return;
+        for (auto [it, end] = ids_.equal_range(h); it != end; ++it)
+            f(it->second);
+    }
+};
+
+/**
+ * @brief Read a stream by @p read(buf, n), until it returns less than n,
+ *        and call @p on_hit(offset, id) for every window of it that
+ *        starts at offset and hashes as the pattern id of @p patterns.
+ */
+template <class Read, class Hit>
+void scan(Read&& read, const table& patterns, Hit&& on_hit, std::size_t chunk = 1<<20)
+{
+    // The last window of the previous chunk stays in front of the next one.
+    const auto buf = std::make_unique_for_overwrite<unsigned char[]>(window + chunk);
+    std::size_t have = 0;     // bytes in buf
+    std::uint64_t base = 0;   // offset of buf[0] in the stream
+    std::uint64_t h = 0;
+    bool started = false;
+
+    for (bool more = true; more; ) {
+        const auto n = read(reinterpret_cast<char*>(buf.get() + have), chunk);
+        more = n == chunk;
+        const auto end = have + n;
+        std::size_t pos = window; // the window ending before pos
+        if (!started) {
+            if (end < window)
+                return;
+            h = hash(buf.get());
+            started = true;
+            patterns.find(h, [&](std::uint32_t id) { on_hit(base, id); });
+        }
+        for (; pos < end; pos++) {
+            h = roll(h, buf[pos - window], buf[pos]);
+            patterns.find(h, [&](std::uint32_t id) { on_hit(base + pos - window + 1, id); });
+        }
+        std::memmove(buf.get(), buf.get() + end - window, window);
+        base += end - window;
+        have = window;
+    }
+}
+
+/**
+ * @brief The digest of the @p size bytes at @p offset that
+ *        @p read_at(buf, n, offset) reads, or nothing if it fails.
+ */
+template <class ReadAt>
+std::optional<xxh::hash128_t> span_digest(ReadAt&& read_at, std::uint64_t offset, std::uint64_t size)
+{
+    constexpr std::size_t chunk = 1<<16;
+    thread_local const auto buf = std::make_unique_for_overwrite<char[]>(chunk);
+    thread_local xxh::hash3_state128_t state;
+    state.reset();
+    for (std::uint64_t pos = 0; pos < size; ) {
+        const auto n = static_cast<std::size_t>(std::min<std::uint64_t>(chunk, size - pos));
+        if (!read_at(buf.get(), n, offset + pos))
+            return std::nullopt;
+        state.update(buf.get(), n);
+        pos += n;
+    }
+    return state.digest();
+}
+
+} // namespace dfs::contain
@@ -0,0 +1,245 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Hash the decompressed content of gzip and zstd files.
+ *
+ * Compressed files are recognized by their extension and checked by magic.
+ * Their grouping key is the uncompressed size modulo 2^32, which both
+ * formats can tell without decompressing: gzip keeps it in the trailer,
+ * zstd in the frame header when the compressor wrote it.
+ * A multi-member gzip file only records its last member, so its key
+ * may miss equal content stored in a single member. A zstd file records
+ * a size per frame, so one of several frames, such as pzstd writes, or
+ * starting with a skippable frame, is not keyed and always decompressed.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <zlib.h>
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define DFS_HAVE_ZSTD 1
+#endif
+
+#include "xxhash.hpp"
+
+namespace dfs::decompress
+{
+
+enum class format { none, gzip, zstd };
+
+inline format detect(const std::filesystem::path& file)
+{
+    auto ext = file.extension().string();
+    for (auto& c: ext)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    if (ext == ".gz" || ext == ".tgz")
+        return format::gzip;
+#ifdef DFS_HAVE_ZSTD
+    if (ext == ".zst" || ext == ".zstd" || ext == ".tzst")
+        return format::zstd;
+#endif
+    return format::none;
+}
+
+#ifdef DFS_HAVE_ZSTD
+namespace detail
+{
+    /**
+     * @brief The compressed size of the zstd frame whose header is @p head,
+     *        at the start of @p fin, found by walking its block headers.
+     *
+     * @return nothing if it is not a zstd data frame.
+     */
+    inline std::optional<std::uint64_t> zstd_frame_size(std::ifstream& fin, const std::array<unsigned char, 18>& head)
+    {
+        if (head[0] != 0x28 || head[1] != 0xb5 || head[2] != 0x2f || head[3] != 0xfd)
+            return std::nullopt;
+        const unsigned fhd = head[4];
+        const bool single_segment = fhd >> 5 & 1;
+        constexpr unsigned dict_id_bytes[] {0, 1, 2, 4};
+        constexpr unsigned content_size_bytes[] {0, 2, 4, 8};
+        const unsigned fcs = fhd >> 6 ? content_size_bytes[fhd >> 6] : single_segment;
+        std::uint64_t pos = 5 + !single_segment + dict_id_bytes[fhd & 3] + fcs;
+
+        for (bool last = false; !last; ) {
+            unsigned char b[3];
+            fin.clear();
+            fin.seekg(pos);
+            if (!fin.read(reinterpret_cast<char*>(b), 3))
+                return std::nullopt;
+            const std::uint32_t header = b[0] | b[1] << 8 | b[2] << 16;
+            const auto type = header >> 1 & 3; // raw, RLE, compressed, reserved
+            if (type == 3)
+                return std::nullopt;
+            last = header & 1;
+            pos += 3 + (type == 1 ? 1 : header >> 3);
+        }
+        return pos + (fhd >> 2 & 1) * 4; // and the checksum
+    }
+}
+#endif
+
+/**
+ * @brief The uncompressed size modulo 2^32, if it is recorded for all of it.
+ */
+inline std::optional<std::uint32_t> size_key(const std::string& file, format fmt, std::uint64_t filesize)
+{
+    std::ifstream fin(file, std::ios_base::binary);
+    std::array<unsigned char, 18> head{};
+
+    if (!fin.read(reinterpret_cast<char*>(head.data()), std::min<std::uint64_t>(head.size(), filesize)))
+        if (fin.gcount() < 4)
+            return std::nullopt;
+
+    if (fmt == format::gzip) {
+        if (filesize < 18 || head[0] != 0x1f || head[1] != 0x8b)
+            return std::nullopt;
+        unsigned char t[4];
+        fin.clear();
+        fin.seekg(filesize - 4);
+        if (!fin.read(reinterpret_cast<char*>(t), 4))
+            return std::nullopt;
+        return std::uint32_t(t[0]) | std::uint32_t(t[1]) << 8 | std::uint32_t(t[2]) << 16 | std::uint32_t(t[3]) << 24;
+    }
+#ifdef DFS_HAVE_ZSTD
+    if (fmt == format::zstd) {
+        auto size = ZSTD_getFrameContentSize(head.data(), std::min<std::size_t>(head.size(), filesize));
+        if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR)
+            return std::nullopt;
+        if (detail::zstd_frame_size(fin, head) != filesize) // more frames follow
+            return std::nullopt;
+        return static_cast<std::uint32_t>(size);
+    }
+#endif
+    return std::nullopt;
+}
+
+struct content
+{
+    std::uint64_t size;     // decompressed
+    xxh::hash128_t digest;  // of the decompressed content
+    xxh::hash128_t raw;     // of the bytes as stored
+};
+
+/**
+ * @brief Stream @p file through its decompressor and hash the output,
+ *        calling @p on_read(n) after reading every n bytes of it.
+ *
+ * @return nothing if the file cannot be read or is not valid.
+ */
+template <class OnRead>
+std::optional<content> hash_content(const std::string& file, format fmt, OnRead&& on_read)
+{
+    constexpr std::size_t bufsize {1<<16}; // 64 KiB
+    thread_local auto in = std::make_unique_for_overwrite<char[]>(bufsize);
+    thread_local auto out = std::make_unique_for_overwrite<char[]>(bufsize);
+    thread_local xxh::hash3_state128_t state, raw;
+
+    std::ifstream fin(file, std::ios_base::binary);
+    if (!fin)
+        return std::nullopt;
+    state.reset();
+    raw.reset();
+    std::uint64_t size = 0;
+
+    if (fmt == format::gzip)
+    {
+        z_stream zs{};
+        if (inflateInit2(&zs, 15 + 16) != Z_OK)
+            return std::nullopt;
+        std::unique_ptr<z_stream, decltype(&inflateEnd)> guard(&zs, inflateEnd);
+        int ret = Z_OK;
+
+        do {
+            fin.read(in.get(), bufsize);
+            on_read(static_cast<std::size_t>(fin.gcount()));
+            raw.update(in.get(), fin.gcount());
+            zs.next_in = reinterpret_cast<Bytef*>(in.get());
+            zs.avail_in = static_cast<uInt>(fin.gcount());
+            if (zs.avail_in == 0)
+                break;
+            while (zs.avail_in > 0) {
+                if (ret == Z_STREAM_END) // another member follows
+                    inflateReset(&zs);
+                zs.next_out = reinterpret_cast<Bytef*>(out.get());
+                zs.avail_out = bufsize;
+                ret = inflate(&zs, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+                    return std::nullopt;
+                const auto n = bufsize - zs.avail_out;
+                state.update(out.get(), n);
+                size += n;
+                if (ret == Z_BUF_ERROR && n == 0)
+                    break;
+            }
+        } while (fin);
+
+        // drain what is still buffered inside zlib
+        while (ret == Z_OK) {
+            zs.next_out = reinterpret_cast<Bytef*>(out.get());
+            zs.avail_out = bufsize;
+            ret = inflate(&zs, Z_NO_FLUSH);
+            const auto n = bufsize - zs.avail_out;
+            state.update(out.get(), n);
+            size += n;
+            if (n == 0)
+                break;
+        }
+        if (ret != Z_STREAM_END)
+            return std::nullopt;
+    }
+#ifdef DFS_HAVE_ZSTD
+    else if (fmt == format::zstd)
+    {
+        std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        std::size_t ret = 0;
+
+        do {
+            fin.read(in.get(), bufsize);
+            on_read(static_cast<std::size_t>(fin.gcount()));
+            raw.update(in.get(), fin.gcount());
+            ZSTD_inBuffer ib{in.get(), static_cast<std::size_t>(fin.gcount()), 0};
+            while (ib.pos < ib.size) {
+                ZSTD_outBuffer ob{out.get(), bufsize, 0};
+                ret = ZSTD_decompressStream(dctx.get(), &ob, &ib);
+                if (ZSTD_isError(ret))
+                    return std::nullopt;
+                state.update(out.get(), ob.pos);
+                size += ob.pos;
+            }
+        } while (fin);
+
+        // flush what is still buffered; once a frame has ended, another
+        // call would start waiting for the next one
+        while (ret != 0) {
+            ZSTD_inBuffer ib{nullptr, 0, 0};
+            ZSTD_outBuffer ob{out.get(), bufsize, 0};
+            ret = ZSTD_decompressStream(dctx.get(), &ob, &ib);
+            if (ZSTD_isError(ret))
+                return std::nullopt;
+            state.update(out.get(), ob.pos);
+            size += ob.pos;
+            if (ob.pos == 0)
+                break;
+        }
+        if (ret != 0) // truncated frame
+            return std::nullopt;
+    }
+#endif
+    else
+        return std::nullopt;
+
+    return content{size, state.digest(), raw.digest()};
+}
+
+} // namespace dfs::decompress
@@ -0,0 +1,249 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Open files by name in directories kept open, instead of by path.
+ *
+ * Opening a file by its full path makes the kernel resolve every component
+ * of the path again, which adds up on deep trees and costs round trips on
+ * network filesystems. A dir_cache keeps the directories of recently opened
+ * files open, each opened by name in its own parent's, and opens a file
+ * with openat on its name; at most a budget of directories are kept,
+ * the least recently used closed first.
+ * Elsewhere than on POSIX systems files are opened by path.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "probes.hpp"
+
+namespace dfs
+{
+
+#ifndef _WIN32
+
+class dir_cache
+{
+    struct handle {
+        int fd;
+        explicit handle(int fd) noexcept : fd(fd) {}
+        handle(const handle&) = delete;
+        handle& operator=(const handle&) = delete;
+        ~handle() { ::close(fd); }
+    };
+    using handle_ptr = std::shared_ptr<const handle>; // an evicted one closes when no longer used
+
+    std::size_t budget_;
+    std::list<std::pair<std::string, handle_ptr>> lru_; // most recently used first
+    std::unordered_map<std::string_view, decltype(lru_)::iterator> map_;
+    std::mutex mutex_;
+
+#ifdef __linux__
+    static constexpr int dir_flags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+#else
+    static constexpr int dir_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+#endif
+
+    /**
+     * @brief The open directory @p dir, or null if it cannot be opened.
+     *        Must hold the mutex.
+     */
+    handle_ptr get(std::string_view dir)
+    {
+        if (auto it = map_.find(dir); it != map_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return it->second->second;
+        }
+
+        int fd = -1;
+        const auto slash = dir.rfind('/');
+        if (slash != std::string_view::npos && slash+1 < dir.size())
+            if (auto parent = get(dir.substr(0, std::max<std::size_t>(slash, 1))))
+                fd = ::openat(parent->fd, std::string(dir.substr(slash+1)).c_str(), dir_flags);
+        if (fd < 0)
+            fd = ::open(std::string(dir).c_str(), dir_flags);
+        if (fd < 0)
+            return nullptr;
+
+        lru_.emplace_front(std::string(dir), std::make_shared<const handle>(fd));
+        map_.emplace(lru_.front().first, lru_.begin());
+        while (lru_.size() > budget_) {
+            map_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+        return lru_.front().second;
+    }
+
+public:
+    /**
+     * @brief Keep at most @p budget directories open.
+     */
+    explicit dir_cache(std::size_t budget) : budget_(std::max<std::size_t>(budget, 1)) {}
+
+    dir_cache(const dir_cache&) = delete;
+    dir_cache& operator=(const dir_cache&) = delete;
+
+    /**
+     * @brief A budget of a quarter of the descriptors the process may open.
+     */
+    static std::size_t default_budget()
+    {
+        rlimit lim;
+        if (::getrlimit(RLIMIT_NOFILE, &lim) != 0 || lim.rlim_cur == RLIM_INFINITY)
+            return 256;
+        return std::clamp<std::size_t>(lim.rlim_cur / 4, 16, 4096);
+    }
+
+    /**
+     * @brief Open @p file read-only, by name in its directory.
+     *
+     * @return the file descriptor, or -1 with errno set.
+     */
+    int open(const std::string& file)
+    {
+        const auto slash = file.rfind('/');
+        if (slash != std::string::npos && slash+1 < file.size()) {
+            handle_ptr dir;
+            {
+                std::lock_guard lock(mutex_);
+                dir = get(std::string_view(file).substr(0, std::max<std::size_t>(slash, 1)));
+            }
+            if (dir)
+                if (int fd = ::openat(dir->fd, file.c_str() + slash+1, O_RDONLY | O_CLOEXEC); fd >= 0)
+                    return fd;
+        }
+        return ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+};
+
+/**
+ * @brief A file read in order or at offsets,
+ *        opened through a dir_cache if there is one.
+ */
+class input_file
+{
+    int fd_ = -1;
+
+public:
+    explicit input_file(const std::string& file, dir_cache *dirs = nullptr)
+        : fd_(dirs ? dirs->open(file) : ::open(file.c_str(), O_RDONLY | O_CLOEXEC))
+    {
+        DFS_PROBE(file_open, file.c_str(), fd_);
+    }
+
+    input_file(const input_file&) = delete;
+    input_file& operator=(const input_file&) = delete;
+    ~input_file() { if (fd_ >= 0) ::close(fd_); }
+
+    explicit operator bool() const noexcept { return fd_ >= 0; }
+
+    /**
+     * @brief Read up to @p n bytes from the current position.
+     *
+     * @return the bytes read, less than @p n only at the end or on an error.
+     */
+    std::size_t read(char *buf, std::size_t n)
+    {
+        std::size_t done = 0;
+        while (fd_ >= 0 && done < n) {
+            DFS_PROBE(read_start, fd_, std::int64_t(-1), n - done);
+            const auto r = ::read(fd_, buf + done, n - done);
+            DFS_PROBE(read_done, fd_, r);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                break;
+            done += r;
+        }
+        return done;
+    }
+
+    /**
+     * @brief Read exactly @p n bytes at @p offset, without moving.
+     */
+    bool read_at(char *buf, std::size_t n, std::uint64_t offset)
+    {
+        std::size_t done = 0;
+        while (fd_ >= 0 && done < n) {
+            DFS_PROBE(read_start, fd_, offset + done, n - done);
+            const auto r = ::pread(fd_, buf + done, n - done, static_cast<off_t>(offset + done));
+            DFS_PROBE(read_done, fd_, r);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                break;
+            done += r;
+        }
+        return done == n;
+    }
+
+    void seek(std::uint64_t offset)
+    {
+        if (fd_ >= 0)
+            ::lseek(fd_, static_cast<off_t>(offset), SEEK_SET);
+    }
+};
+
+#else
+
+class dir_cache
+{
+public:
+    explicit dir_cache(std::size_t) {}
+    static std::size_t default_budget() { return 0; }
+};
+
+class input_file
+{
+    std::ifstream in_;
+
+public:
+    explicit input_file(const std::string& file, dir_cache* = nullptr)
+        : in_(file, std::ios_base::binary)
+    {}
+
+    explicit operator bool() const noexcept { return in_.is_open(); }
+
+    std::size_t read(char *buf, std::size_t n)
+    {
+        in_.read(buf, n);
+        return static_cast<std::size_t>(in_.gcount());
+    }
+
+    bool read_at(char *buf, std::size_t n, std::uint64_t offset)
+    {
+        in_.clear();
+        const auto pos = in_.tellg();
+        in_.seekg(offset);
+        const bool ok = static_cast<bool>(in_.read(buf, n));
+        in_.clear();
+        in_.seekg(pos);
+        return ok;
+    }
+
+    void seek(std::uint64_t offset)
+    {
+        in_.clear();
+        in_.seekg(offset);
+    }
+};
+
+#endif
+
+} // namespace dfs
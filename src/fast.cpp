@@ -21,6 +21,11 @@ Size:  xxx.x MiB (xxx xxx xxx B)
 Possible redundant data size: x.xxx MiB (x xxx xxx B)
 
 Done in x.xxxs.
+
+ * With --samples, every group header also carries an upper bound
+ * of the probability that it holds a differing file, like
+ #1 [n1]  xx.xx MiB (xx xxx xxx B)  P(miss) <= x.xxe-xx
+ * and the largest bound is printed before the redundant data size.
  */
 
 #include <print>
@@ -29,12 +34,18 @@ Done in x.xxxs.
 #include <filesystem>
 
 #include <bit>
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <ranges>
 #include <map>
+#include <charconv>
+#include <random>
+#include <string_view>
 #include <vector>
 
 #include "xxhash.hpp"
+#include "radix.hpp"
 
 namespace fs = std::filesystem;
 namespace ranges = std::ranges;
@@ -66,12 +77,83 @@ std::string prettify_bytes(std::size_t size)
     return o.str();
 };
 
+constexpr std::size_t bufsize {1<<18}; // 256 KiB
+
+/**
+ * @brief Random block sampling between the head and tail windows.
+ *
+ * The mutation model is a single run of @p mutation differing bytes
+ * anywhere in the unread middle of a file. Such a run touches at least
+ * ceil(mutation/block) aligned blocks, and a file pair is only taken
+ * as equal if none of those is among the @p samples blocks drawn.
+ */
+struct sampling
+{
+    static constexpr std::uint64_t block = 1<<12; // 4 KiB, aligned
+
+    std::uint64_t samples = 0;
+    std::uint64_t seed = 0;
+    std::uint64_t mutation = block;
+
+    /**
+     * @brief The aligned blocks of the middle of a file of @p filesize bytes.
+     */
+    static std::pair<std::uint64_t, std::uint64_t> middle(std::uint64_t filesize)
+    {
+        const auto first = bufsize/2 / block;
+        const auto last = (filesize - bufsize/2 + block - 1) / block;
+        return {first, last > first ? last - first : 0};
+    }
+
+    /**
+     * @brief Draw the sampled block offsets, the same for every file of @p filesize bytes.
+     */
+    std::vector<std::uint64_t> offsets(std::uint64_t filesize) const
+    {
+        const auto [first, n] = middle(filesize);
+        const auto k = std::min(samples, n);
+        std::mt19937_64 rng(seed ^ filesize);
+        std::vector<std::uint64_t> picked;
+
+        // Floyd's algorithm: k distinct blocks out of n.
+        for (auto j = n - k; j < n; j++) {
+            auto t = rng() % (j + 1);
+            picked.push_back(ranges::find(picked, t) == picked.end() ? t : j);
+        }
+        ranges::sort(picked);
+        for (auto& b: picked)
+            b = (first + b) * block;
+        return picked;
+    }
+
+    /**
+     * @brief Upper bound of the probability that one differing file
+     *        of @p filesize bytes hashes equal to another.
+     */
+    double miss_probability(std::uint64_t filesize) const
+    {
+        if (filesize <= bufsize)
+            return 0;
+        const auto [first, n] = middle(filesize);
+        const auto d = std::max<std::uint64_t>(1, (mutation + block - 1) / block);
+        const auto k = std::min(samples, n);
+        if (k + d > n)
+            return 0;
+        // C(n-d, k) / C(n, k), by hypergeometric terms.
+        double p = 1;
+        for (std::uint64_t i=0; i<k; i++)
+            p *= double(n - d - i) / double(n - i);
+        return p;
+    }
+};
+
 /**
  * @brief Group the same files in @p filelist into @p res.
  *
  * Algorithm:
  * In case of small files, hash the whole files.
  * Or else, hash the first bytes and last bytes,
+ * and the blocks drawn by @p smp if any,
  * *ignoring the rest*, and group files by hash value.
  * Every multiple group is a result.
  *
@@ -80,9 +162,8 @@ std::string prettify_bytes(std::size_t size)
  * *so be sure to remember to screen again.*
  */
 template<class Iterable, class Container>
-void hash_check(Iterable&& filelist, Container &res)
+void hash_check(Iterable&& filelist, Container &res, const sampling& smp = {})
 {
-    constexpr std::size_t bufsize {1<<18}; // 256 KiB
     thread_local auto buf = std::make_unique_for_overwrite<char[]>(bufsize);
     std::map<xxh::hash128_t, typename Container::value_type> hashmap;
 
@@ -96,6 +177,9 @@ void hash_check(Iterable&& filelist, Container &res)
         }
     }
     else {
+        const auto offsets = smp.offsets(filesize);
+        xxh::hash3_state128_t state;
+
         for (auto&& file: filelist)
         {
             constexpr auto halfsize {bufsize/2};
@@ -106,6 +190,16 @@ void hash_check(Iterable&& filelist, Container &res)
             fin.read(buf.get() + halfsize, halfsize);
 
             auto hash = xxh::xxhash3<128>(buf.get(), bufsize);
+            if (!offsets.empty()) {
+                state.reset();
+                state.update(buf.get(), bufsize);
+                for (auto off: offsets) {
+                    fin.seekg(off);
+                    fin.read(buf.get(), sampling::block);
+                    state.update(buf.get(), fin.gcount());
+                }
+                hash = state.digest();
+            }
             hashmap[hash].emplace_back(std::forward_like<Iterable>(file));
         }
     }
@@ -156,13 +250,17 @@ auto search(const fs::path& dir, Container& size_map)
  * 2. Group files by size, with empty files directly output.
  * 3. For each group of multiple files, group them by hashing.
  * 4. If an ultimate group is multiple, output it.
+ *
+ * With sampling, the bound of a group of n files is the union bound
+ * (n-1) * P(miss) over its members differing from the first one.
  */
-void duplicate_file_search(const fs::path dirpath)
+void duplicate_file_search(const fs::path dirpath, const sampling& smp)
 {
     std::map<std::uint64_t, std::vector<std::string>> size_map;
     search(dirpath, size_map);
     std::size_t num=0;
     std::uintmax_t rdsize=0; // redundant data size
+    double max_miss=0;
 
     for (auto&& pair: size_map)
     {
@@ -172,12 +270,18 @@ void duplicate_file_search(const fs::path dirpath)
             continue;
 
         std::vector<std::vector<std::string>> res;
-        hash_check(std::move(paths), res);
+        hash_check(std::move(paths), res, smp);
         for (auto&& paths: res) {
             num++;
             rdsize += filesize * (paths.size()-1);
-            ranges::sort(paths);
-            std::println(" #{} [{}]  {}", num, paths.size(), prettify_bytes(filesize));
+            dfs::radix::sort(paths);
+            if (smp.samples) {
+                auto miss = std::min(1.0, (paths.size()-1) * smp.miss_probability(filesize));
+                max_miss = std::max(max_miss, miss);
+                std::println(" #{} [{}]  {}  P(miss) <= {:.3g}", num, paths.size(), prettify_bytes(filesize), miss);
+            }
+            else
+                std::println(" #{} [{}]  {}", num, paths.size(), prettify_bytes(filesize));
             for (const auto& p: paths)
                 // This needs to be enforced on Windows.
                 std::vprint_nonunicode("{}\n", std::make_format_args(p));
@@ -185,27 +289,66 @@ void duplicate_file_search(const fs::path dirpath)
         }
     }
 
+    if (smp.samples)
+        std::println("Largest miss probability bound: {:.3g}\n", max_miss);
+
     std::println("Possible redundant data size: {}\n\nDone in {:.3f}s.",
                     prettify_bytes(rdsize) , (double)clock()/CLOCKS_PER_SEC);
 }
 
+void usage()
+{
+    std::println("Usage: fastdfs [options] [directory]\n\n"
+                 "Options:\n"
+                 "  --samples <k>      also hash k random 4 KiB blocks between head and tail\n"
+                 "  --seed <n>         seed of the block sampling (default 0)\n"
+                 "  --mutation <bytes> smallest differing run assumed by the error bound\n"
+                 "                     (default one block)");
+}
+
 int main(int argc, char *argv[])
 {
-    fs::path dir;
+    fs::path dir {"."};
+    sampling smp;
 
-    if (argc <= 1) {
-        dir = ".";
-    }
-    else {
-        dir = argv[1];
-        if (!fs::exists(dir) || !fs::is_directory(dir))
-        {
-            std::println("No such directory.");
+    for (int i=1; i<argc; i++)
+    {
+        std::string_view arg = argv[i];
+        auto number = [&](std::uint64_t& v) {
+            if (i+1 >= argc)
+                return false;
+            std::string_view s = argv[++i];
+            auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+            return ec == std::errc{} && p == s.data() + s.size();
+        };
+        bool ok = true;
+        if (arg == "--samples")
+            ok = number(smp.samples);
+        else if (arg == "--seed")
+            ok = number(smp.seed);
+        else if (arg == "--mutation")
+            ok = number(smp.mutation);
+        else if (arg == "-h" || arg == "--help") {
+            usage();
             return 0;
         }
+        else if (arg.starts_with("--"))
+            ok = false;
+        else
+            dir = argv[i];
+        if (!ok) {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!fs::exists(dir) || !fs::is_directory(dir))
+    {
+        std::println("No such directory.");
+        return 0;
     }
 
-    try { duplicate_file_search(dir); }
+    try { duplicate_file_search(dir, smp); }
     catch (const fs::filesystem_error& fs_err) {
         std::println(stderr, "Filesystem Exception: {}", fs_err.what());
     }
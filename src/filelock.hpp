@@ -0,0 +1,101 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Advisory lock on a file, shared between processes.
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace dfs
+{
+
+/**
+ * @brief A whole-file lock, exclusive or shared, on a lock file
+ *        created if missing.
+ *
+ * It meets the Lockable and SharedLockable requirements,
+ * so std::lock_guard and std::shared_lock work with it.
+ * The lock is released by the OS if the process dies.
+ */
+class file_lock
+{
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+
+    void acquire(DWORD flags)
+    {
+        OVERLAPPED ov{};
+        if (!LockFileEx(file_, flags, 0, MAXDWORD, MAXDWORD, &ov))
+            throw std::runtime_error("Cannot lock file");
+    }
+#else
+    int fd_ = -1;
+
+    void acquire(int op)
+    {
+        while (::flock(fd_, op) != 0)
+            if (errno != EINTR)
+                throw std::runtime_error("Cannot lock file");
+    }
+#endif
+
+public:
+    explicit file_lock(const std::filesystem::path& file)
+    {
+#ifdef _WIN32
+        file_ = CreateFileW(file.c_str(), GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+#else
+        fd_ = ::open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+        if (fd_ < 0)
+#endif
+            throw std::runtime_error("Cannot open: " + file.string());
+    }
+
+    file_lock(const file_lock&) = delete;
+    file_lock& operator=(const file_lock&) = delete;
+
+    ~file_lock()
+    {
+#ifdef _WIN32
+        CloseHandle(file_);
+#else
+        ::close(fd_);
+#endif
+    }
+
+#ifdef _WIN32
+    void lock() { acquire(LOCKFILE_EXCLUSIVE_LOCK); }
+    void lock_shared() { acquire(0); }
+    void unlock() noexcept
+    {
+        OVERLAPPED ov{};
+        UnlockFileEx(file_, 0, MAXDWORD, MAXDWORD, &ov);
+    }
+    void unlock_shared() noexcept { unlock(); }
+#else
+    void lock() { acquire(LOCK_EX); }
+    void lock_shared() { acquire(LOCK_SH); }
+    void unlock() noexcept { ::flock(fd_, LOCK_UN); }
+    void unlock_shared() noexcept { unlock(); }
+#endif
+};
+
+} // namespace dfs
@@ -0,0 +1,185 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Front-coded storage of sorted strings.
+ *
+ * Sorted paths share long directory prefixes with their predecessor.
+ * Strings are cut into blocks of a fixed count; the first string of a block
+ * is stored whole, every other one as the length of the prefix shared
+ * with the previous string plus the remaining suffix.
+ * A block index gives random access: decoding string i touches one block only.
+ *
+ * Layout (little-endian):
+ *   u64 count, u64 block size, u64 offsets[nblocks+1] relative to the data,
+ *   then the data. Lengths are LEB128 varints.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dfs::frontcode
+{
+
+inline constexpr std::uint64_t default_block_size = 16;
+
+inline void put_varint(std::vector<char>& out, std::uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline std::uint64_t get_varint(const char *&p, const char *end)
+{
+    std::uint64_t v = 0;
+    for (int shift=0; p < end && shift < 64; shift += 7) {
+        auto b = static_cast<std::uint8_t>(*p++);
+        v |= std::uint64_t(b & 0x7f) << shift;
+        if (b < 0x80)
+            return v;
+    }
+    throw std::runtime_error("Corrupted front-coded strings.");
+}
+
+/**
+ * @brief Encode @p strings, which must be sorted.
+ */
+template <class Range>
+std::vector<char> encode(const Range& strings, std::uint64_t block_size = default_block_size)
+{
+    std::vector<char> data;
+    std::vector<std::uint64_t> offsets;
+    std::string_view prev;
+    std::uint64_t count = 0;
+
+    for (std::string_view s: strings)
+    {
+        if (count % block_size == 0) {
+            offsets.push_back(data.size());
+            put_varint(data, s.size());
+            data.insert(data.end(), s.begin(), s.end());
+        }
+        else {
+            std::size_t lcp = 0;
+            while (lcp < prev.size() && lcp < s.size() && prev[lcp] == s[lcp])
+                lcp++;
+            put_varint(data, lcp);
+            put_varint(data, s.size() - lcp);
+            data.insert(data.end(), s.begin() + lcp, s.end());
+        }
+        prev = s;
+        count++;
+    }
+    offsets.push_back(data.size());
+
+    std::vector<char> out((3 + offsets.size()) * sizeof(std::uint64_t));
+    std::uint64_t head[3] {count, block_size, offsets.size() - 1};
+    std::memcpy(out.data(), head, sizeof head);
+    std::memcpy(out.data() + sizeof head, offsets.data(), offsets.size() * sizeof(std::uint64_t));
+    out.insert(out.end(), data.begin(), data.end());
+    return out;
+}
+
+/**
+ * @brief Decode strings in place from an encoded buffer.
+ */
+class view
+{
+    std::uint64_t count_ = 0, block_size_ = 1;
+    std::span<const std::uint64_t> offsets_;
+    std::string_view data_;
+
+    [[noreturn]] static void corrupted()
+    {
+        throw std::runtime_error("Corrupted front-coded strings.");
+    }
+
+    /**
+     * @brief Decode the strings of block @p b into @p s one by one,
+     *        calling @p f(index, s) after each; stop when it returns false.
+     */
+    template <class F>
+    void decode_block(std::uint64_t b, std::string& s, F&& f) const
+    {
+        const char *p = data_.data() + offsets_[b], *end = data_.data() + offsets_[b+1];
+        const auto first = b * block_size_;
+        const auto last = std::min(first + block_size_, count_);
+        for (auto i = first; i < last; i++)
+        {
+            std::uint64_t lcp = 0;
+            if (i != first) {
+                lcp = get_varint(p, end);
+                if (lcp > s.size())
+                    corrupted();
+            }
+            auto len = get_varint(p, end);
+            if (len > std::uint64_t(end - p))
+                corrupted();
+            s.resize(lcp);
+            s.append(p, len);
+            p += len;
+            if (!f(i, s))
+                return;
+        }
+    }
+
+public:
+    view() = default;
+
+    explicit view(std::span<const char> bytes)
+    {
+        std::uint64_t head[3];
+        if (bytes.size() < sizeof head)
+            corrupted();
+        std::memcpy(head, bytes.data(), sizeof head);
+        count_ = head[0];
+        block_size_ = head[1];
+        const auto nblocks = head[2];
+        if (block_size_ == 0 || nblocks != (count_ + block_size_ - 1) / block_size_
+         || (bytes.size() - sizeof head) / sizeof(std::uint64_t) <= nblocks)
+            corrupted();
+        if (reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(std::uint64_t))
+            throw std::runtime_error("Misaligned front-coded strings.");
+        offsets_ = {reinterpret_cast<const std::uint64_t*>(bytes.data() + sizeof head), nblocks + 1};
+        data_ = {bytes.data() + sizeof head + offsets_.size_bytes(),
+                 bytes.size() - sizeof head - offsets_.size_bytes()};
+        for (std::uint64_t b=0; b<nblocks; b++)
+            if (offsets_[b] > offsets_[b+1])
+                corrupted();
+        if (offsets_.back() > data_.size())
+            corrupted();
+    }
+
+    std::uint64_t size() const noexcept { return count_; }
+
+    std::string operator[](std::uint64_t i) const
+    {
+        if (i >= count_)
+            throw std::out_of_range("Front-coded string index out of range.");
+        std::string s;
+        decode_block(i / block_size_, s, [&](auto j, const auto&) { return j != i; });
+        return s;
+    }
+
+    /**
+     * @brief Call @p f(index, string) for every string in order.
+     */
+    template <class F>
+    void for_each(F&& f) const
+    {
+        std::string s;
+        for (std::uint64_t b=0; b+1<offsets_.size(); b++)
+            decode_block(b, s, [&](auto i, const std::string& str) { f(i, str); return true; });
+    }
+};
+
+} // namespace dfs::frontcode
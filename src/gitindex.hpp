@@ -0,0 +1,187 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Blob ids of the unmodified tracked files in git work trees.
+ *
+ * A git index (.git/index, versions 2 to 4) records for every tracked
+ * file its blob id along with the stat data it had when git last looked.
+ * A file that still has that size, mtime and inode holds that blob,
+ * unless its mtime is not older than the index itself ("racily clean"),
+ * which git would check by content too and so is not trusted here.
+ *
+ * The blob is the content before checkout filters such as line-ending
+ * conversion, so files of equal blob id are only equal if they are of
+ * equal size too, which holds for the size groups they are compared in.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace dfs::git
+{
+
+namespace fs = std::filesystem;
+
+struct entry
+{
+    std::uint32_t mtime_s, mtime_ns;
+    std::uint32_t ino;
+    std::uint32_t size; // modulo 2^32
+    std::string oid;    // hex
+};
+
+namespace detail
+{
+    inline std::uint32_t be32(const unsigned char *p)
+    {
+        return std::uint32_t(p[0]) << 24 | std::uint32_t(p[1]) << 16 | std::uint32_t(p[2]) << 8 | p[3];
+    }
+
+    inline std::uint16_t be16(const unsigned char *p)
+    {
+        return static_cast<std::uint16_t>(p[0] << 8 | p[1]);
+    }
+
+    /**
+     * @brief The length of object ids in the repository at @p git_dir.
+     */
+    inline std::size_t oid_size(const fs::path& git_dir)
+    {
+        std::ifstream in(git_dir / "config");
+        for (std::string line; std::getline(in, line); ) {
+            std::erase_if(line, [](char c) { return c == ' ' || c == '\t'; });
+            if (line == "objectformat=sha256" || line == "objectFormat=sha256")
+                return 32;
+        }
+        return 20;
+    }
+
+    inline std::int64_t to_unix_ns(fs::file_time_type t)
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(clock_cast<system_clock>(t).time_since_epoch()).count();
+    }
+}
+
+/**
+ * @brief The regular, stage-0 entries of the index of the repository
+ *        at @p git_dir, keyed by their generic path in the work tree.
+ *
+ * @throw std::runtime_error if the index cannot be read or is damaged.
+ */
+inline std::unordered_map<std::string, entry> read_index(const fs::path& git_dir, const fs::path& work_tree)
+{
+    using namespace detail;
+    constexpr std::uint16_t extended = 0x4000, skip_worktree = 0x4000, intent_to_add = 0x2000;
+
+    std::ifstream in(git_dir / "index", std::ios_base::binary);
+    std::vector<unsigned char> data{std::istreambuf_iterator<char>(in), {}};
+    const auto fail = [] [[noreturn]] { throw std::runtime_error("damaged git index"); };
+
+    if (data.size() < 12 || std::memcmp(data.data(), "DIRC", 4) != 0)
+        fail();
+    const auto version = be32(&data[4]);
+    const auto count = be32(&data[8]);
+    if (version < 2 || version > 4)
+        throw std::runtime_error("unsupported git index version");
+
+    const auto oid = oid_size(git_dir);
+    const auto index_time = to_unix_ns(fs::last_write_time(git_dir / "index"));
+    std::unordered_map<std::string, entry> res;
+    std::string name; // kept for the prefix compression of version 4
+    std::size_t pos = 12;
+
+    for (std::uint32_t i=0; i<count; i++)
+    {
+        const auto start = pos;
+        if (data.size() - pos < 40 + oid + 2)
+            fail();
+        const unsigned char *p = &data[pos];
+        entry e{be32(p+8), be32(p+12), be32(p+20), be32(p+36), {}};
+        const auto mode = be32(p+24);
+        static constexpr char hex[] = "0123456789abcdef";
+        for (std::size_t k=0; k<oid; k++) {
+            e.oid += hex[p[40+k] >> 4];
+            e.oid += hex[p[40+k] & 15];
+        }
+        const auto flags = be16(p + 40 + oid);
+        pos += 40 + oid + 2;
+        std::uint16_t ext = 0;
+        if (flags & extended) {
+            if (version < 3 || data.size() - pos < 2)
+                fail();
+            ext = be16(&data[pos]);
+            pos += 2;
+        }
+
+        if (version == 4) {
+            std::uint64_t strip = 0;
+            for (int shift = 0; ; shift += 7) { // git's offset varint
+                if (pos >= data.size() || shift > 56)
+                    fail();
+                const auto b = data[pos++];
+                strip = (strip << 7 | (b & 0x7f)) + ((b & 0x80) ? 1 : 0);
+                if (!(b & 0x80))
+                    break;
+            }
+            if (strip > name.size())
+                fail();
+            name.resize(name.size() - strip);
+        }
+        else
+            name.clear();
+        const auto *nul = static_cast<const unsigned char*>(std::memchr(&data[pos], 0, data.size() - pos));
+        if (!nul)
+            fail();
+        name.append(reinterpret_cast<const char*>(&data[pos]), nul - &data[pos]);
+        pos = nul - data.data() + 1;
+        if (version < 4)
+            pos = start + ((pos - start + 7) & ~std::size_t(7));
+        if (pos > data.size())
+            fail();
+
+        const bool regular = (mode & 0170000) == 0100000;
+        const std::int64_t mtime = std::int64_t(e.mtime_s) * 1'000'000'000 + e.mtime_ns;
+        if (regular && ((flags >> 12) & 3) == 0 && !(ext & (skip_worktree | intent_to_add)) && mtime < index_time)
+            res.emplace((work_tree / name).generic_string(), std::move(e));
+    }
+    return res;
+}
+
+/**
+ * @brief Whether @p file still has the stat data of @p e.
+ */
+inline bool unmodified(const std::string& file, const entry& e)
+{
+    std::error_code ec;
+    if (fs::symlink_status(file, ec).type() != fs::file_type::regular)
+        return false;
+    const auto size = fs::file_size(file, ec);
+    const auto time = fs::last_write_time(file, ec);
+    if (ec || static_cast<std::uint32_t>(size) != e.size)
+        return false;
+    const auto ns = detail::to_unix_ns(time);
+    if (ns / 1'000'000'000 != e.mtime_s || (e.mtime_ns && ns % 1'000'000'000 != e.mtime_ns))
+        return false;
+#ifndef _WIN32
+    struct stat st;
+    if (e.ino && (::stat(file.c_str(), &st) != 0 || static_cast<std::uint32_t>(st.st_ino) != e.ino))
+        return false;
+#endif
+    return true;
+}
+
+} // namespace dfs::git
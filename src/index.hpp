@@ -0,0 +1,415 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Persistent, memory-mappable index of a duplicate search.
+ *
+ * File layout (little-endian, every section 16-byte aligned):
+ *   header       magic, version, counts and the section table
+ *   files        file_record[nfiles], sorted by (size, digest, path)
+ *   groups       group_record[ngroups], the duplicate groups, by (size, digest)
+ *   digests      group_record[ndigests], files of one digest, by digest mphf slot
+ *   digest_mphf  perfect hash of the low 64 bits of every digest
+ *   paths        the sorted paths, front-coded (see frontcode.hpp)
+ *   path_files   uint32 file index of every sorted path
+ *   path_slots   uint32 sorted path index, by path mphf slot
+ *   path_mphf    perfect hash of xxh3-64 of every path
+ *
+ * Paths are absolute and in generic format.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "xxhash.hpp"
+#include "mmap.hpp"
+#include "mphf.hpp"
+#include "frontcode.hpp"
+#include "radix.hpp"
+
+namespace dfs::index
+{
+
+static_assert(std::endian::native == std::endian::little, "Index files are little-endian.");
+
+inline constexpr char magic[8] {'D','F','S','I','N','D','E','X'};
+inline constexpr std::uint32_t version = 2;
+inline constexpr std::uint32_t no_group = UINT32_MAX;
+
+enum section : std::uint32_t {
+    files, groups, digests, digest_mphf, paths, path_files, path_slots, path_mphf,
+    section_count
+};
+
+struct section_entry {
+    std::uint64_t offset, size; // in bytes
+};
+
+struct header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t nfiles, ngroups, ndigests;
+    section_entry sections[section_count];
+};
+
+enum file_flags : std::uint32_t {
+    has_digest = 1, // the whole content was hashed
+};
+
+struct file_record {
+    std::uint64_t size;
+    std::int64_t mtime;     // file_clock ticks of the writing platform
+    xxh::hash128_t digest;  // valid if flags & has_digest
+    std::uint32_t group;    // index into groups, or no_group
+    std::uint32_t path;     // index into the sorted paths
+    std::uint32_t flags;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(file_record) == 48);
+
+struct group_record {
+    std::uint32_t first, count; // a range of files
+};
+
+/**
+ * @brief The form in which paths are stored and looked up.
+ */
+inline std::string normalize_path(const std::filesystem::path& p)
+{
+    return std::filesystem::absolute(p).lexically_normal().generic_string();
+}
+
+/**
+ * @brief Modification time in file_clock ticks, or 0 if unavailable.
+ */
+inline std::int64_t file_mtime(const std::filesystem::path& p) noexcept
+{
+    std::error_code ec;
+    auto t = std::filesystem::last_write_time(p, ec);
+    return ec ? 0 : t.time_since_epoch().count();
+}
+
+inline std::uint64_t path_key(std::string_view p) noexcept
+{
+    return xxh::xxhash3<64>(p.data(), p.size());
+}
+
+inline bool digest_less(const xxh::hash128_t& a, const xxh::hash128_t& b) noexcept
+{
+    return a.high64 != b.high64 ? a.high64 < b.high64 : a.low64 < b.low64;
+}
+
+/**
+ * @brief Compare two files in the order of the files section, paths aside:
+ *        by size, then files with a digest first, then by digest.
+ *
+ * @return <0, 0 or >0; 0 for equal sizes without digests too.
+ */
+inline int compare_content(const file_record& a, const file_record& b) noexcept
+{
+    if (a.size != b.size)
+        return a.size < b.size ? -1 : 1;
+    const bool da = a.flags & has_digest, db = b.flags & has_digest;
+    if (da != db)
+        return da ? -1 : 1;
+    if (!da || a.digest == b.digest)
+        return 0;
+    return digest_less(a.digest, b.digest) ? -1 : 1;
+}
+
+inline std::string to_hex(const xxh::hash128_t& h)
+{
+    return std::format("{:016x}{:016x}", h.high64, h.low64);
+}
+
+inline std::optional<xxh::hash128_t> from_hex(std::string_view s)
+{
+    if (s.size() != 32)
+        return std::nullopt;
+    xxh::hash128_t h;
+    for (std::size_t i=0; i<32; i++) {
+        auto c = s[i];
+        unsigned v = c>='0' && c<='9' ? c-'0' : c>='a' && c<='f' ? c-'a'+10
+                   : c>='A' && c<='F' ? c-'A'+10 : 16;
+        if (v == 16)
+            return std::nullopt;
+        auto& part = i < 16 ? h.high64 : h.low64;
+        part = part << 4 | v;
+    }
+    return h;
+}
+
+
+/**
+ * @brief Collect the files of a search and write them as an index.
+ */
+class builder
+{
+    struct entry {
+        std::string path;
+        std::uint64_t size;
+        std::int64_t mtime;
+        xxh::hash128_t digest;
+        bool has_digest = false;
+    };
+    std::vector<entry> entries_;
+    std::vector<std::pair<std::string, xxh::hash128_t>> digests_;
+
+    template <class T, std::size_t N>
+    static void put(std::ofstream& out, std::span<T, N> data)
+    {
+        out.write(reinterpret_cast<const char*>(data.data()), data.size_bytes());
+    }
+
+    static void align(std::ofstream& out)
+    {
+        while (out.tellp() % 16)
+            out.put('\0');
+    }
+
+public:
+    /**
+     * @brief Record a non-empty regular file.
+     */
+    void add(const std::string& path, std::uint64_t size)
+    {
+        entries_.push_back({path, size, file_mtime(path), {}});
+    }
+
+    /**
+     * @brief Record the full-content digest of a file added before.
+     */
+    void set_digest(const std::string& path, const xxh::hash128_t& digest)
+    {
+        digests_.emplace_back(path, digest);
+    }
+
+    void write(const std::filesystem::path& file)
+    {
+        radix::sort(digests_, &decltype(digests_)::value_type::first);
+        for (auto& e: entries_)
+            if (auto it = std::ranges::lower_bound(digests_, e.path, {}, &decltype(digests_)::value_type::first);
+                it != digests_.end() && it->first == e.path)
+            {
+                e.digest = it->second;
+                e.has_digest = true;
+            }
+        digests_.clear();
+        digests_.shrink_to_fit();
+
+        for (auto& e: entries_)
+            e.path = normalize_path(e.path);
+        std::ranges::sort(entries_, [](const entry& a, const entry& b) {
+            if (a.size != b.size) return a.size < b.size;
+            if (a.has_digest != b.has_digest) return a.has_digest;
+            if (a.digest != b.digest) return digest_less(a.digest, b.digest);
+            return a.path < b.path;
+        });
+
+        const auto n = entries_.size();
+        std::vector<file_record> files(n);
+        std::vector<group_record> groups, digests;
+        std::vector<std::uint64_t> digest_keys;
+
+        for (std::size_t i=0, j; i<n; i=j)
+        {
+            for (j=i+1; j<n && entries_[j].has_digest && entries_[i].has_digest
+                        && entries_[j].size == entries_[i].size
+                        && entries_[j].digest == entries_[i].digest; j++);
+            std::uint32_t group = no_group;
+            if (entries_[i].has_digest) {
+                digests.push_back({(std::uint32_t)i, (std::uint32_t)(j-i)});
+                digest_keys.push_back(entries_[i].digest.low64);
+                if (j-i > 1) {
+                    group = groups.size();
+                    groups.push_back(digests.back());
+                }
+            }
+            for (auto k=i; k<j; k++) {
+                const auto& e = entries_[k];
+                files[k] = {e.size, e.mtime, e.digest, group, 0,
+                            e.has_digest ? has_digest : 0u, 0};
+            }
+        }
+
+        auto digest_words = mphf::build(digest_keys);
+        mphf::view digest_fn(digest_words);
+        std::vector<group_record> digest_slots(digests.size());
+        for (auto& d: digests)
+            digest_slots[*digest_fn(files[d.first].digest.low64)] = d;
+
+        std::vector<std::uint32_t> order(n);
+        for (std::uint32_t i=0; i<n; i++)
+            order[i] = i;
+        radix::sort(order, [&](auto i) -> const std::string& { return entries_[i].path; });
+
+        std::vector<std::uint64_t> path_keys;
+        for (std::uint32_t r=0; r<n; r++) {
+            files[order[r]].path = r;
+            path_keys.push_back(path_key(entries_[order[r]].path));
+        }
+        auto path_data = frontcode::encode(order | std::views::transform(
+            [&](auto i) -> std::string_view { return entries_[i].path; }));
+
+        auto path_words = mphf::build(path_keys);
+        mphf::view path_fn(path_words);
+        std::vector<std::uint32_t> path_slots(n);
+        for (std::uint32_t r=0; r<n; r++)
+            path_slots[*path_fn(path_keys[r])] = r;
+
+        std::ofstream out(file, std::ios_base::binary | std::ios_base::trunc);
+        if (!out)
+            throw std::runtime_error("Cannot write index: " + file.string());
+
+        header h{};
+        std::memcpy(h.magic, magic, sizeof magic);
+        h.version = version;
+        h.nfiles = n;
+        h.ngroups = groups.size();
+        h.ndigests = digests.size();
+        put(out, std::span(&h, 1));
+        align(out);
+
+        auto section = [&](enum section s, auto&& data) {
+            h.sections[s].offset = out.tellp();
+            put(out, std::span(data));
+            h.sections[s].size = (std::uint64_t)out.tellp() - h.sections[s].offset;
+            align(out);
+        };
+        section(section::files, files);
+        section(section::groups, groups);
+        section(section::digests, digest_slots);
+        section(section::digest_mphf, digest_words);
+        section(section::paths, path_data);
+        std::vector<std::uint32_t> path_files(n);
+        for (std::uint32_t r=0; r<n; r++)
+            path_files[r] = order[r];
+        section(section::path_files, path_files);
+        section(section::path_slots, path_slots);
+        section(section::path_mphf, path_words);
+
+        out.seekp(0);
+        put(out, std::span(&h, 1));
+        if (!out)
+            throw std::runtime_error("Cannot write index: " + file.string());
+    }
+};
+
+
+/**
+ * @brief Query an index file in place through a memory mapping.
+ */
+class reader
+{
+    mapped_file map_;
+    const header *h_ = nullptr;
+    std::span<const file_record> files_;
+    std::span<const group_record> groups_, digests_;
+    frontcode::view paths_;
+    std::span<const std::uint32_t> path_files_, path_slots_;
+    mphf::view digest_fn_, path_fn_;
+
+    [[noreturn]] static void corrupted()
+    {
+        throw std::runtime_error("Corrupted index file.");
+    }
+
+    template <class T>
+    std::span<const T> get(section s) const
+    {
+        const auto& e = h_->sections[s];
+        if (e.offset % alignof(T) || e.offset > map_.size() || e.size > map_.size() - e.offset)
+            corrupted();
+        return {reinterpret_cast<const T*>(map_.data() + e.offset), e.size / sizeof(T)};
+    }
+
+public:
+    explicit reader(const std::filesystem::path& file) : map_(file)
+    {
+        if (map_.size() < sizeof(header))
+            corrupted();
+        h_ = reinterpret_cast<const header*>(map_.data());
+        if (std::memcmp(h_->magic, magic, sizeof magic) != 0)
+            throw std::runtime_error("Not an index file: " + file.string());
+        if (h_->version != version)
+            throw std::runtime_error("Unsupported index version.");
+
+        files_ = get<file_record>(section::files);
+        groups_ = get<group_record>(section::groups);
+        digests_ = get<group_record>(section::digests);
+        digest_fn_ = mphf::view(get<std::uint64_t>(section::digest_mphf));
+        paths_ = frontcode::view(get<char>(section::paths));
+        path_files_ = get<std::uint32_t>(section::path_files);
+        path_slots_ = get<std::uint32_t>(section::path_slots);
+        path_fn_ = mphf::view(get<std::uint64_t>(section::path_mphf));
+
+        if (files_.size() < h_->nfiles || groups_.size() < h_->ngroups
+         || digests_.size() < h_->ndigests || paths_.size() != h_->nfiles
+         || path_files_.size() < h_->nfiles || path_slots_.size() < h_->nfiles)
+            corrupted();
+        files_ = files_.first(h_->nfiles);
+        groups_ = groups_.first(h_->ngroups);
+        digests_ = digests_.first(h_->ndigests);
+    }
+
+    std::span<const file_record> files() const noexcept { return files_; }
+    std::span<const group_record> groups() const noexcept { return groups_; }
+
+    std::span<const file_record> files(const group_record& g) const
+    {
+        if (g.first > files_.size() || g.count > files_.size() - g.first)
+            corrupted();
+        return files_.subspan(g.first, g.count);
+    }
+
+    std::string path(const file_record& f) const
+    {
+        if (f.path >= h_->nfiles)
+            corrupted();
+        return paths_[f.path];
+    }
+
+    /**
+     * @brief Find the file of @p path, which must be normalized.
+     */
+    const file_record* find_path(std::string_view path) const
+    {
+        auto slot = path_fn_(path_key(path));
+        if (!slot || *slot >= path_slots_.size())
+            return nullptr;
+        auto r = path_slots_[*slot];
+        if (r >= path_files_.size() || path_files_[r] >= files_.size())
+            corrupted();
+        const auto& f = files_[path_files_[r]];
+        return this->path(f) == path ? &f : nullptr;
+    }
+
+    /**
+     * @brief Find all files whose whole content has @p digest.
+     */
+    std::span<const file_record> find_digest(const xxh::hash128_t& digest) const
+    {
+        auto slot = digest_fn_(digest.low64);
+        if (!slot || *slot >= digests_.size())
+            return {};
+        auto fs = files(digests_[*slot]);
+        if (fs.empty() || !(fs.front().flags & has_digest) || fs.front().digest != digest)
+            return {};
+        return fs;
+    }
+};
+
+} // namespace dfs::index
@@ -28,13 +28,51 @@ Done in x.xxxs.
 #include <sstream>
 #include <filesystem>
 
+#include <atomic>
 #include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <ranges>
+#include <regex>
 #include <map>
+#include <semaphore>
+#include <span>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include "xxhash.hpp"
+#include "index.hpp"
+#include "cache.hpp"
+#include "decompress.hpp"
+#include "textnorm.hpp"
+#include "tuning.hpp"
+#include "mmap.hpp"
+#include "mounts.hpp"
+#include "walk.hpp"
+#include "cas.hpp"
+#include "gitindex.hpp"
+#include "metrics.hpp"
+#include "sketch.hpp"
+#include "dircache.hpp"
+#include "planner.hpp"
+#include "radix.hpp"
+#include "pressure.hpp"
+#include "probes.hpp"
+#include "contain.hpp"
 
 namespace fs = std::filesystem;
 namespace ranges = std::ranges;
@@ -66,100 +104,1271 @@ std::string prettify_bytes(std::size_t size)
     return o.str();
 };
 
+struct options
+{
+    fs::path dir {"."};
+    fs::path index; // write a queryable index here if not empty
+    fs::path cache; // keep digests between runs here if not empty
+    bool block_digests = false; // also keep digests of the blocks of large files in the cache
+    bool prefix = false; // also find files that are truncated copies of others
+    bool contained = false; // also find files contained whole in larger ones
+    std::string since; // only check files changed after a time or an index
+    bool decompress = false; // also compare gzip/zstd files by their content
+    bool text = false; // also compare text files ignoring line ends and trailing blanks
+    bool full_digests = false; // hash every file, for indices to compare across runs
+    fs::path sketch; // write a content sketch, to estimate overlap across hosts, if not empty
+    dfs::cas::matcher cas; // paths in content-addressed stores
+    bool git = false; // group unmodified tracked files of git work trees by blob id
+    unsigned cas_checks = 0; // copies hashed to verify each store or blob group
+    dfs::tuning::settings tune; // threads, queue depth and buffer size
+    std::string metrics; // export live counters to this file, or unix:<socket>, if not empty
+    bool heuristic = false; // group by size and name only, reading no data
+    bool heuristic_mtime = false; // and by mtime
+    unsigned verify_top = 0; // heuristic groups verified by content, those of most redundant bytes
+    std::optional<dfs::tuning::profile> profile; // calibrated rates, for the planner
+    bool explain = false; // print the plan of every size group instead of searching
+    double pace = 0; // back off reading when more of the time than this is stalled, 0 for never
+};
+
+/**
+ * @brief Live counters of a search, exported with --metrics.
+ */
+struct search_metrics
+{
+    enum { by_size, by_since, by_ends, by_digest }; // stages of elimination
+    enum { clone, copy }; // why files are grouped unread
+    enum { hit, resumed, miss }; // cache lookups
+
+    dfs::metrics::counter files_scanned, scanned_bytes;
+    dfs::metrics::counter eliminated[4];
+    dfs::metrics::counter unread[2];
+    dfs::metrics::counter cache_lookups[3];
+    dfs::metrics::counter hashed_bytes;
+    dfs::metrics::histogram hash_seconds{{1e-4, 1e-3, 1e-2, 0.1, 1, 10, 60}};
+    dfs::metrics::gauge reads_in_flight[2], queue_depth[2], pending_groups; // per lane, small and large files
+    std::vector<std::unique_ptr<dfs::metrics::counter>> read_bytes; // per device
+    std::vector<std::size_t> device_of; // per mount, the index in read_bytes
+
+    void read(std::size_t mount, std::uint64_t n)
+    {
+        if (mount < device_of.size())
+            read_bytes[device_of[mount]]->add(n);
+    }
+
+    /**
+     * @brief Name the counters in @p reg, with a device for every mount
+     *        in @p mounts of a search of @p dir.
+     */
+    void describe(dfs::metrics::registry& reg, const dfs::mounts::table& mounts, const fs::path& dir)
+    {
+        using dfs::metrics::escape;
+        std::map<std::string, std::size_t> devices;
+        for (const auto& m: mounts) {
+            auto dev = dfs::tuning::device_id(m.path.empty() ? dir : fs::path(m.path));
+            auto [it, fresh] = devices.try_emplace(dev, read_bytes.size());
+            if (fresh) {
+                read_bytes.push_back(std::make_unique<dfs::metrics::counter>());
+                reg.add("dfsearch_read_bytes", "Bytes read to hash files, per device.",
+                        *read_bytes.back(), std::format("device=\"{}\"", escape(dev)), "bytes");
+            }
+            device_of.push_back(it->second);
+        }
+        reg.add("dfsearch_files_scanned", "Regular files found.", files_scanned);
+        reg.add("dfsearch_scanned_bytes", "Total size of the regular files found.", scanned_bytes, {}, "bytes");
+        constexpr std::string_view stages[] {"size", "since", "ends", "digest"};
+        for (int i=0; i<4; i++)
+            reg.add("dfsearch_eliminated_files", "Files ruled out as duplicates, per stage.",
+                    eliminated[i], std::format("stage=\"{}\"", stages[i]));
+        reg.add("dfsearch_unread_files", "Files grouped without reading them.", unread[clone], "reason=\"clone\"");
+        reg.add("dfsearch_unread_files", "Files grouped without reading them.", unread[copy], "reason=\"copy\"");
+        constexpr std::string_view results[] {"hit", "resumed", "miss"};
+        for (int i=0; i<3; i++)
+            reg.add("dfsearch_cache_lookups", "Digests looked up in the cache or an earlier index.",
+                    cache_lookups[i], std::format("result=\"{}\"", results[i]));
+        reg.add("dfsearch_hashed_bytes", "Bytes hashed whole.", hashed_bytes, {}, "bytes");
+        reg.add("dfsearch_hash_seconds", "Time to hash a file whole.", hash_seconds, {}, "seconds");
+        constexpr std::string_view lanes[] {"small", "large"};
+        for (int l=0; l<2; l++) {
+            const auto lane = std::format("lane=\"{}\"", lanes[l]);
+            reg.add("dfsearch_reads_in_flight", "Files being hashed whole.", reads_in_flight[l], lane);
+            reg.add("dfsearch_queue_depth", "Files allowed to be read at once per mount.", queue_depth[l], lane);
+        }
+        reg.add("dfsearch_pending_groups", "Size groups not yet reported.", pending_groups);
+    }
+};
+
+/**
+ * @brief What the hashing stage may use besides the files themselves.
+ */
+struct hash_context
+{
+    dfs::hash_cache *cache = nullptr;
+    const dfs::index::reader *previous = nullptr; // an earlier index
+    const dfs::mounts::table *mounts = nullptr;
+    // per mount, bounds the files read at once there if not null
+    std::span<const std::unique_ptr<std::counting_semaphore<>>> reads;
+    std::size_t bufsize = 1<<15;
+    search_metrics *metrics = nullptr;
+    unsigned lane = 0;
+    bool blocks = false; // keep and compare block digests in the cache
+    dfs::dir_cache *dirs = nullptr; // open files by name in their directory
+    const dfs::planner::model *planner = nullptr; // the default model if null
+    bool digests = false; // every digest is wanted, so no files are compared directly
+    dfs::pressure::pacer *pacer = nullptr; // backs off reading under system pressure if not null
+
+    /**
+     * @brief The index of the mount holding @p file, 0 without a mount table.
+     */
+    std::size_t mount_of(const std::string& file) const
+    {
+        return mounts ? mounts->find(dfs::index::normalize_path(file)) : 0;
+    }
+
+    const dfs::mounts::policy& policy(std::size_t mount) const
+    {
+        static const dfs::mounts::policy none;
+        return mounts ? (*mounts)[mount].pol : none;
+    }
+};
+
+/**
+ * @brief Hold one of the read slots of @p mount in @p ctx while alive,
+ *        and one of those the pacer allows.
+ */
+class read_slot
+{
+    std::counting_semaphore<> *s_;
+    dfs::pressure::pacer *p_;
+public:
+    read_slot(const hash_context& ctx, std::size_t mount)
+        : s_(mount < ctx.reads.size() ? ctx.reads[mount].get() : nullptr), p_(ctx.pacer)
+    {
+        if (s_) s_->acquire();
+        if (p_) p_->acquire();
+    }
+    ~read_slot()
+    {
+        if (p_) p_->release();
+        if (s_) s_->release();
+    }
+    read_slot(const read_slot&) = delete;
+    read_slot& operator=(const read_slot&) = delete;
+};
+
+/**
+ * @brief Call @p f(on_read) in a read slot of the mount of @p file in @p ctx,
+ *        where on_read(n), called after reading every n bytes, paces
+ *        and counts the reading as @p ctx says.
+ *
+ * @return what @p f returns.
+ */
+template <class F>
+auto paced_read(const hash_context& ctx, const std::string& file, F&& f)
+{
+    const auto mount = ctx.mount_of(file);
+    read_slot slot(ctx, mount);
+    auto paced = std::chrono::steady_clock::now();
+    return f([&](std::size_t n) {
+        if (ctx.pacer)
+            paced = ctx.pacer->throttle(paced);
+        if (ctx.metrics)
+            ctx.metrics->read(mount, n);
+    });
+}
+
+/**
+ * @brief Parse a UTC time "YYYY-MM-DD[THH:MM[:SS]]" or "@<unix seconds>".
+ *
+ * @return file_clock ticks, as stored in indices and caches.
+ */
+std::optional<std::int64_t> parse_time(const std::string& s)
+{
+    using namespace std::chrono;
+    sys_seconds t;
+    long long secs;
+    int y;
+    unsigned mo, d, h=0, mi=0, sec=0;
+    char c;
+
+    if (std::sscanf(s.c_str(), "@%lld%c", &secs, &c) == 1)
+        t = sys_seconds{seconds{secs}};
+    else if (int n = std::sscanf(s.c_str(), "%d-%u-%u%*1[T ]%u:%u:%u", &y, &mo, &d, &h, &mi, &sec);
+             n == 3 || n >= 5)
+    {
+        year_month_day ymd{year{y}, month{mo}, day{d}};
+        if (!ymd.ok() || h > 23 || mi > 59 || sec > 60)
+            return std::nullopt;
+        t = sys_days{ymd} + hours{h} + minutes{mi} + seconds{sec};
+    }
+    else
+        return std::nullopt;
+
+    return time_point_cast<file_clock::duration>(clock_cast<file_clock>(t)).time_since_epoch().count();
+}
+
+/**
+ * @brief Tell files that are new or changed since a time or an earlier index.
+ */
+struct since_filter
+{
+    std::optional<std::int64_t> time;
+    const dfs::index::reader *previous = nullptr;
+
+    bool is_new(const std::string& file, std::uint64_t filesize) const
+    {
+        auto mtime = dfs::index::file_mtime(file);
+        if (time)
+            return mtime > *time;
+        const auto *f = previous->find_path(dfs::index::normalize_path(file));
+        return !f || f->size != filesize || f->mtime != mtime;
+    }
+};
+
+/**
+ * @brief Look up the digest of @p file without reading it.
+ *
+ * It is known if the cache or the earlier index has it
+ * with the same size and mtime as now.
+ */
+std::optional<xxh::hash128_t> known_digest(const std::string& file, std::uint64_t filesize,
+                                           const hash_context& ctx)
+{
+    if (!ctx.cache && !ctx.previous)
+        return std::nullopt;
+
+    auto mtime = dfs::index::file_mtime(file);
+    std::optional<xxh::hash128_t> digest;
+    if (ctx.cache)
+        if (auto e = ctx.cache->find(file); e && e->size == filesize && e->mtime == mtime)
+            digest = e->digest;
+    if (ctx.previous && !digest)
+        if (const auto *f = ctx.previous->find_path(dfs::index::normalize_path(file));
+            f && (f->flags & dfs::index::has_digest) && f->size == filesize && f->mtime == mtime)
+            digest = f->digest;
+    if (digest) {
+        DFS_PROBE(cache_hit, file.c_str(), filesize);
+        if (ctx.metrics)
+            ctx.metrics->cache_lookups[search_metrics::hit].add();
+    }
+    else
+        DFS_PROBE(cache_miss, file.c_str(), filesize);
+    return digest;
+}
+
+struct ignore_digest
+{
+    void operator()(const auto&, const auto&) const noexcept {}
+};
+
+struct all_blocks
+{
+    bool operator()(std::size_t, std::uint64_t) const noexcept { return true; }
+};
+
+/**
+ * @brief Hash the whole content of @p file of @p filesize bytes,
+ *        unless @p keep_going(i, digest) gives up after its block i.
+ *
+ * With a cache, an unchanged file is not read at all,
+ * and a file that only grew since is hashed from the saved state onward.
+ * With block digests, every whole block of a large file not resumed
+ * is passed to @p keep_going, and all of them are cached.
+ * On mounts whose policy says so, the file is hashed from a memory mapping,
+ * and otherwise opened through the directory cache of @p ctx if any.
+ *
+ * @return the digest, or nothing if given up, or if the file cannot be
+ *         opened or read to @p filesize bytes; nothing is cached then.
+ */
+template <class Filter>
+std::optional<xxh::hash128_t> hash_blocks(const std::string& file, std::uint64_t filesize,
+                                          const hash_context& ctx, Filter&& keep_going)
+{
+    constexpr auto block_size = dfs::hash_cache::block_size;
+    // Hashed at once up to this size, whatever the buffer, leaving no state to save.
+    constexpr std::uint64_t one_shot_size = 1<<15;
+    static_assert(one_shot_size < dfs::hash_cache::snapshot_min_size);
+    const std::size_t bufsize = std::max<std::size_t>(ctx.bufsize, one_shot_size);
+    thread_local std::unique_ptr<char[]> buf;
+    thread_local std::size_t capacity = 0;
+    thread_local xxh::hash3_state128_t state;
+    thread_local xxh::hash3_state64_t block_state;
+    std::int64_t mtime = 0;
+    std::uint64_t resumed = 0; // length the state was resumed at
+
+    if (auto hash = known_digest(file, filesize, ctx))
+        return *hash;
+
+    if (capacity < bufsize) {
+        buf = std::make_unique_for_overwrite<char[]>(bufsize);
+        capacity = bufsize;
+    }
+    const auto mount = ctx.mount_of(file);
+    read_slot slot(ctx, mount);
+    const auto start = std::chrono::steady_clock::now();
+    struct in_flight {
+        search_metrics *m;
+        unsigned lane;
+        ~in_flight() { if (m) m->reads_in_flight[lane].sub(); }
+    } flight{ctx.metrics, ctx.lane};
+    if (ctx.metrics)
+        ctx.metrics->reads_in_flight[ctx.lane].add();
+
+    std::optional<dfs::mapped_file> mapped;
+    if (ctx.policy(mount).map)
+        try {
+            mapped.emplace(file);
+            if (mapped->size() != filesize)
+                mapped.reset();
+        }
+        catch (const std::exception&) {}
+    const char *mem = mapped ? reinterpret_cast<const char*>(mapped->data()) : nullptr;
+    std::optional<dfs::input_file> fin;
+    if (!mem) {
+        fin.emplace(file, ctx.dirs);
+        if (!*fin)
+            return std::nullopt;
+    }
+
+    // The @p n bytes ending at @p end.
+    auto read_back = [&](std::uint64_t end, std::uint64_t n) -> const char* {
+        if (mem)
+            return mem + end - n;
+        return fin->read_at(buf.get(), n, end - n) ? buf.get() : nullptr;
+    };
+
+    if (ctx.cache)
+    {
+        mtime = dfs::index::file_mtime(file);
+        if (auto e = ctx.cache->find(file))
+        {
+            // Resume only if the old content still ends the same way.
+            if (e->snap && e->size < filesize)
+            {
+                const auto tail = std::min(e->size, dfs::hash_cache::tail_size);
+                const auto *p = read_back(e->size, tail);
+                if (p && xxh::xxhash3<64>(p, tail) == e->snap->tail_hash
+                      && state.deserialize(e->snap->state.data()))
+                    resumed = e->size;
+                if (resumed)
+                    DFS_PROBE(cache_resume, file.c_str(), resumed);
+                if (resumed && !mem)
+                    fin->seek(resumed);
+            }
+        }
+    }
+
+    auto report = [&](std::uint64_t hashed) {
+        [[maybe_unused]] const std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        DFS_PROBE(hash_done, file.c_str(), filesize, hashed, std::chrono::duration_cast<std::chrono::nanoseconds>(took).count());
+        if (auto *m = ctx.metrics) {
+            m->read(mount, hashed);
+            m->hashed_bytes.add(hashed);
+            m->hash_seconds.observe(took.count());
+            if (ctx.cache || ctx.previous)
+                m->cache_lookups[resumed ? search_metrics::resumed : search_metrics::miss].add();
+        }
+    };
+
+    // The digests of the blocks so far, and how far the current one is.
+    const bool by_blocks = ctx.blocks && ctx.cache && !resumed && filesize > block_size;
+    std::vector<std::uint64_t> blocks;
+    std::uint64_t block_fill = 0;
+    auto paced = start;
+    auto feed = [&](const char *p, std::uint64_t n) -> bool {
+        if (ctx.pacer)
+            paced = ctx.pacer->throttle(paced);
+        state.update(p, n);
+        while (by_blocks && n) {
+            const auto take = std::min(n, block_size - block_fill);
+            block_state.update(p, take);
+            p += take;
+            n -= take;
+            if ((block_fill += take) == block_size) {
+                blocks.push_back(block_state.digest());
+                block_state.reset();
+                block_fill = 0;
+                if (!keep_going(blocks.size()-1, blocks.back()))
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    xxh::hash128_t hash;
+    if (!resumed)
+        state.reset();
+    block_state.reset();
+    // A mapping is hashed as the buffer would be filled by reads.
+    if (!resumed && filesize <= one_shot_size) {
+        const char *p = mem;
+        if (!p) {
+            if (fin->read(buf.get(), filesize) != filesize) {
+                report(0);
+                return std::nullopt;
+            }
+            p = buf.get();
+        }
+        hash = xxh::xxhash3<128>(p, filesize);
+    }
+    else if (mem) {
+        for (auto pos = resumed; pos < filesize; ) {
+            const auto n = std::min<std::uint64_t>(bufsize, filesize - pos);
+            pos += n;
+            if (!feed(mem + pos - n, n)) {
+                report(pos - resumed);
+                return std::nullopt;
+            }
+        }
+        hash = state.digest();
+    }
+    else {
+        // Up to the size found by the search, failing if the file shrank.
+        for (auto pos = resumed; pos < filesize; ) {
+            const auto n = static_cast<std::size_t>(std::min<std::uint64_t>(bufsize, filesize - pos));
+            const auto got = fin->read(buf.get(), n);
+            pos += got;
+            if (got != n || !feed(buf.get(), n)) {
+                report(pos - resumed);
+                return std::nullopt;
+            }
+        }
+        hash = state.digest();
+    }
+    if (block_fill)
+        blocks.push_back(block_state.digest());
+
+    if (ctx.cache)
+    {
+        dfs::hash_cache::entry e{filesize, mtime, hash, std::nullopt, {}};
+        if (filesize >= dfs::hash_cache::snapshot_min_size) {
+            // The state has seen the whole file.
+            const auto tail = dfs::hash_cache::tail_size;
+            const auto *p = read_back(filesize, tail);
+            e.snap.emplace();
+            if (p)
+                e.snap->tail_hash = xxh::xxhash3<64>(p, tail);
+            if (!p || !state.serialize(e.snap->state.data()))
+                e.snap.reset();
+        }
+        if (by_blocks && blocks.size() == (filesize + block_size - 1) / block_size)
+            e.blocks = std::move(blocks);
+        ctx.cache->store(file, std::move(e));
+    }
+    report(filesize - resumed);
+    return hash;
+}
+
+/**
+ * @brief Hash the whole content of @p file of @p filesize bytes,
+ *        as hash_blocks does.
+ *
+ * @return the digest, or nothing if the file cannot be read.
+ */
+std::optional<xxh::hash128_t> full_hash(const std::string& file, std::uint64_t filesize, const hash_context& ctx)
+{
+    return hash_blocks(file, filesize, ctx, all_blocks{});
+}
+
+/**
+ * @brief Take the reflinked copies out of @p paths: the files on mounts
+ *        that allow the check whose extents are all the same shared ones
+ *        as those of a file before them.
+ *
+ * @return the files kept in @p paths that have such copies, with them.
+ */
+std::map<std::string, std::vector<std::string>> take_clones(std::vector<std::string>& paths, const hash_context& ctx)
+{
+    std::map<std::pair<std::size_t, std::vector<dfs::mounts::extent>>, std::size_t> seen;
+    std::map<std::string, std::vector<std::string>> clones;
+    std::vector<std::string> kept;
+
+    for (auto& p: paths) {
+        if (const auto mount = ctx.mount_of(p); ctx.policy(mount).shared_extents)
+            if (auto ext = dfs::mounts::shared_extents(p))
+                if (auto [it, fresh] = seen.try_emplace({mount, std::move(*ext)}, kept.size()); !fresh) {
+                    clones[kept[it->second]].push_back(std::move(p));
+                    continue;
+                }
+        kept.push_back(std::move(p));
+    }
+    paths = std::move(kept);
+    return clones;
+}
+
+/**
+ * @brief Take the copies known without reading out of @p paths:
+ *        the files whose content key, by @p key_of(path), is that of a file
+ *        before them, such as the digest embedded in a content-addressed
+ *        store's path or the blob id in a git index.
+ *
+ * Of every such group, as many copies as @p checks are picked at random
+ * and hashed with the first file.
+ * If any of them differs, the whole group stays in @p paths.
+ *
+ * @return the files kept in @p paths that have such copies, with them.
+ */
+template <class KeyOf>
+std::map<std::string, std::vector<std::string>> take_known_copies(std::vector<std::string>& paths, std::uint64_t filesize,
+                                                                  KeyOf&& key_of, unsigned checks,
+                                                                  const hash_context& ctx)
+{
+    std::unordered_map<std::string, std::size_t> seen; // content key to index in kept
+    std::map<std::string, std::vector<std::string>> copies;
+    std::vector<std::string> kept;
+
+    for (auto& p: paths) {
+        if (std::optional<dfs::cas::matcher::match> m = key_of(p))
+            if (auto [it, fresh] = seen.try_emplace(std::move(m->key), kept.size()); !fresh) {
+                const auto& original = kept[it->second];
+                copies[original].push_back(std::move(p));
+                continue;
+            }
+        kept.push_back(std::move(p));
+    }
+
+    for (auto it = copies.begin(); it != copies.end(); )
+    {
+        const auto& [original, group] = *it;
+        const auto n = std::min<std::size_t>(group.size(), checks);
+        bool trusted = true;
+        if (n) {
+            std::mt19937_64 rng(std::hash<std::string>{}(original));
+            std::vector<std::string> sample;
+            ranges::sample(group, std::back_inserter(sample), n, rng);
+            const auto digest = full_hash(original, filesize, ctx);
+            trusted = digest && ranges::all_of(sample, [&](const auto& c) { return full_hash(c, filesize, ctx) == digest; });
+        }
+        if (trusted)
+            ++it;
+        else {
+            ranges::move(it->second, std::back_inserter(kept));
+            it = copies.erase(it);
+        }
+    }
+    paths = std::move(kept);
+    return copies;
+}
+
+/**
+ * @brief Whether @p a and @p b, of @p filesize bytes, are equal,
+ *        reading them in step up to the first difference.
+ */
+bool same_content(const std::string& a, const std::string& b, std::uint64_t filesize, const hash_context& ctx)
+{
+    const std::size_t bufsize = ctx.bufsize;
+    thread_local std::unique_ptr<char[]> buf;
+    thread_local std::size_t capacity = 0;
+    if (capacity < bufsize) {
+        buf = std::make_unique_for_overwrite<char[]>(2 * bufsize);
+        capacity = bufsize;
+    }
+    const auto mount = ctx.mount_of(a);
+    read_slot slot(ctx, mount);
+    dfs::input_file fa(a, ctx.dirs), fb(b, ctx.dirs);
+    if (!fa || !fb)
+        return false;
+
+    auto paced = std::chrono::steady_clock::now();
+    for (std::uint64_t pos = 0; pos < filesize; ) {
+        if (ctx.pacer)
+            paced = ctx.pacer->throttle(paced);
+        const auto n = static_cast<std::size_t>(std::min<std::uint64_t>(bufsize, filesize - pos));
+        const bool same = fa.read(buf.get(), n) == n && fb.read(buf.get() + bufsize, n) == n
+                       && std::memcmp(buf.get(), buf.get() + bufsize, n) == 0;
+        if (ctx.metrics)
+            ctx.metrics->read(mount, 2 * n);
+        if (!same)
+            return false;
+        pos += n;
+    }
+    return true;
+}
+
+/**
+ * @brief Plan the comparison of a size group of @p filesize bytes
+ *        whose @p unread files have no known digest, with @p known
+ *        files that have one, and their blocks cached if @p known_blocks.
+ */
+template <class Files>
+dfs::planner::plan plan_group(std::uint64_t filesize, const Files& unread, std::size_t known, bool known_blocks,
+                              const hash_context& ctx)
+{
+    static const dfs::planner::model fallback;
+    std::vector<std::size_t> mounts;
+    for (const auto& file: unread)
+        mounts.push_back(ctx.mount_of(file));
+    return (ctx.planner ? *ctx.planner : fallback).choose({filesize, mounts, known, known_blocks, ctx.digests});
+}
+
 /**
  * @brief Group the same files in @p filelist into @p res.
  *
- * Algorithm:
- * In case of small files, directly hash the whole files.
- * Or else, hash the first bytes and last bytes firstly,
- * and group files by hash value.
- * Then for each multiple group, hash the entire files
- * and group them by hash value.
+ * Files whose digest is known from @p ctx are not read at all.
+ * The others are compared as planned by the cost model of @p ctx:
+ * - direct: two files are read in step, up to a difference;
+ * - full: every file is hashed whole, and grouped by digest;
+ * - staged: the first bytes and last bytes of every file are hashed,
+ *   and the files of multiple such groups are hashed whole;
+ * - blocks: if the cache has the block digests of every known file,
+ *   the others are hashed block by block against them, and one that
+ *   matches none of them at some block is given up there: it can only
+ *   equal another given up file, which are screened as staged.
  * Every ultimate multiple group is a result.
+ *
+ * Every full-content digest computed is also passed to @p on_digest.
  */
-template<class Iterable, class Container>
-void hash_check(Iterable&& filelist, Container &res)
+template<class Iterable, class Container, class Sink = ignore_digest>
+void hash_check(Iterable&& filelist, Container &res, Sink&& on_digest = {},
+                const hash_context& ctx = {})
 {
     constexpr std::size_t bufsize {1<<15}; // 32 KiB
     thread_local auto buf = std::make_unique_for_overwrite<char[]>(bufsize);
     std::map<xxh::hash128_t, typename Container::value_type> map1, map2;
 
-    if (auto filesize = fs::file_size(*filelist.cbegin()); filesize <= bufsize)
+    const auto filesize = fs::file_size(*filelist.cbegin());
+
+    bool by_blocks = ctx.blocks && ctx.cache && filesize > dfs::hash_cache::block_size;
+    std::map<xxh::hash128_t, std::vector<std::uint64_t>> known_blocks;
+    std::size_t known = 0;
+    typename Container::value_type unknown;
+
+    for (auto&& file: filelist)
     {
-        for (auto&& file: filelist) {
-            std::ifstream fin(file, std::ios_base::binary);
-            fin.read(buf.get(), filesize);
-            auto hash = xxh::xxhash3<128>(buf.get(), filesize);
-            map1[hash].emplace_back(std::forward_like<Iterable>(file));
+        if (auto hash = known_digest(file, filesize, ctx)) {
+            if (by_blocks) {
+                if (auto e = ctx.cache->find(file); e && e->digest == *hash && !e->blocks.empty())
+                    known_blocks.try_emplace(*hash, std::move(e->blocks));
+                else
+                    by_blocks = false;
+            }
+            on_digest(file, *hash);
+            map2[*hash].emplace_back(std::forward_like<Iterable>(file));
+            known++;
         }
-        for (auto& files: map1 | views::values)
-            if (files.size() > 1)
-                res.emplace_back(std::move_if_noexcept(files));
+        else
+            unknown.emplace_back(std::forward_like<Iterable>(file));
+    }
+
+    using dfs::planner::strategy;
+    auto how = plan_group(filesize, unknown, known, by_blocks, ctx).how;
+    DFS_PROBE(plan, filesize, dfs::planner::name(how).data(), unknown.size());
+
+    if (how == strategy::direct)
+    {
+        if (same_content(unknown[0], unknown[1], filesize, ctx))
+            res.emplace_back(std::move(unknown));
+        else if (ctx.metrics)
+            ctx.metrics->eliminated[search_metrics::by_digest].add(2);
         return;
     }
 
-    for (auto&& file: filelist)
+    if (how == strategy::blocks)
     {
-        constexpr auto sbufsize {1<<8}; // 256 B
-        constexpr auto halfsize {sbufsize/2};
+        typename Container::value_type given_up;
+        for (auto& file: unknown) {
+            std::vector<const std::vector<std::uint64_t>*> alive;
+            for (const auto& blocks: known_blocks | views::values)
+                alive.push_back(&blocks);
+            auto hash = hash_blocks(file, filesize, ctx, [&](std::size_t i, std::uint64_t digest) {
+                std::erase_if(alive, [&](const auto *blocks) { return i >= blocks->size() || (*blocks)[i] != digest; });
+                return !alive.empty();
+            });
+            if (hash) {
+                on_digest(file, *hash);
+                map2[*hash].emplace_back(std::move(file));
+            }
+            else
+                given_up.emplace_back(std::move(file));
+        }
+        unknown = std::move(given_up);
+        how = strategy::staged;
+    }
 
-        std::ifstream fin(file, std::ios_base::binary);
-        fin.read(buf.get(), sbufsize - halfsize);
-        fin.seekg(-halfsize, std::ios_base::end);
-        fin.read(buf.get() + halfsize, halfsize);
+    if (how == strategy::staged) {
+        for (auto& file: unknown)
+        {
+            constexpr auto sbufsize {dfs::planner::model::ends_bytes};
+            constexpr auto halfsize {sbufsize/2};
 
-        auto hash = xxh::xxhash3<128>(buf.get(), sbufsize);
-        map1[hash].emplace_back(std::forward_like<Iterable>(file));
+            const bool ok = paced_read(ctx, file, [&](auto&& on_read) {
+                dfs::input_file fin(file, ctx.dirs);
+                if (!fin.read_at(buf.get(), sbufsize - halfsize, 0)
+                 || !fin.read_at(buf.get() + halfsize, halfsize, filesize - halfsize))
+                    return false;
+                on_read(sbufsize);
+                return true;
+            });
+            if (!ok)
+                continue; // unreadable, or changed since the search
+            auto hash = xxh::xxhash3<128>(buf.get(), sbufsize);
+            map1[hash].emplace_back(std::move(file));
+        }
+        DFS_PROBE(stage_split, "ends", filesize, unknown.size(), map1.size());
     }
-
-    xxh::hash3_state128_t state;
+    else if (!unknown.empty())
+        map1[{}] = std::move(unknown); // hashed whole
 
     for (auto& files1: map1 | views::values)
-      if (files1.size() > 1)
-      {
+      if (files1.size() > 1 || how == strategy::full)
         for (auto& file: files1) {
-            std::ifstream fin(file, std::ios_base::binary);
-            state.reset();
-            do {
-                fin.read(buf.get(), bufsize);
-                state.update(buf.get(), fin.gcount());
-            } while(fin);
-            map2[state.digest()].emplace_back(std::move(file));
+            auto hash = full_hash(file, filesize, ctx);
+            if (!hash)
+                continue; // unreadable, or changed since the search
+            on_digest(file, *hash);
+            map2[*hash].emplace_back(std::move(file));
         }
-        for (auto& files2: map2 | views::values)
-            if (files2.size() > 1)
-                res.emplace_back(std::move_if_noexcept(files2));
-        map2.clear();
-      }
+      else if (ctx.metrics)
+          ctx.metrics->eliminated[search_metrics::by_ends].add();
+
+    [[maybe_unused]] std::size_t digested = 0;
+    for (auto& files2: map2 | views::values) {
+        digested += files2.size();
+        if (files2.size() > 1)
+            res.emplace_back(std::move_if_noexcept(files2));
+        else if (ctx.metrics)
+            ctx.metrics->eliminated[search_metrics::by_digest].add();
+    }
+    DFS_PROBE(stage_split, "digest", filesize, digested, map2.size());
+}
+
+/**
+ * @brief Call @p f(i) for every i in [0, @p n) on @p threads threads.
+ */
+template <class F>
+void parallel_for(std::size_t n, unsigned threads, F&& f)
+{
+    std::atomic<std::size_t> next{0};
+    auto work = [&] {
+        for (std::size_t i; (i = next++) < n; )
+            f(i);
+    };
+    std::vector<std::jthread> pool(std::max(1u, threads) - 1);
+    for (auto& t: pool)
+        t = std::jthread(work);
+    work();
 }
 
 /**
- * @brief Search @p dir recursively for all regular files, sorted by size.
+ * @brief Hash @p file from its start up to the last of @p lengths, ascending,
+ *        reading it as @p ctx says.
+ *
+ * @return the digest at every one of @p lengths,
+ *         or nothing if the file cannot be read that far.
+ */
+std::optional<std::vector<xxh::hash128_t>> digests_at(const std::string& file, std::span<const std::uint64_t> lengths,
+                                                      const hash_context& ctx)
+{
+    const std::size_t bufsize = ctx.bufsize;
+    thread_local std::unique_ptr<char[]> buf;
+    thread_local std::size_t capacity = 0;
+    thread_local xxh::hash3_state128_t state;
+    if (capacity < bufsize) {
+        buf = std::make_unique_for_overwrite<char[]>(bufsize);
+        capacity = bufsize;
+    }
+    const auto mount = ctx.mount_of(file);
+    read_slot slot(ctx, mount);
+    dfs::input_file fin(file, ctx.dirs);
+    if (!fin)
+        return std::nullopt;
+
+    std::vector<xxh::hash128_t> res;
+    std::uint64_t pos = 0;
+    auto paced = std::chrono::steady_clock::now();
+    state.reset();
+    for (const auto len: lengths) {
+        while (pos < len) {
+            if (ctx.pacer)
+                paced = ctx.pacer->throttle(paced);
+            const auto n = static_cast<std::size_t>(std::min<std::uint64_t>(bufsize, len - pos));
+            if (fin.read(buf.get(), n) != n)
+                return std::nullopt;
+            if (ctx.metrics)
+                ctx.metrics->read(mount, n);
+            state.update(buf.get(), n);
+            pos += n;
+        }
+        res.push_back(state.digest());
+    }
+    return res;
+}
+
+/**
+ * @brief Find files in @p size_map that are proper prefixes of larger files.
+ *
+ * Algorithm:
+ * 1. Hash every file once, in parallel, taking the digest at every
+ *    power-of-two length that is the bit_floor of the size of a file.
+ *    A file that needs no such digest is looked up in the cache first.
+ * 2. Register every file of size L by its digest at P = bit_floor(L).
+ *    When a larger file has a registered digest at P, every registered
+ *    file of size L is a candidate, a prefix if L == P; otherwise,
+ *    a checkpoint at exactly L is taken for it.
+ * 3. Hash the files with checkpoints again, in parallel, up to the last
+ *    of them: a candidate is a prefix if the digests at L are equal.
+ * Files smaller than @p min_size are never reported as prefixes.
+ *
+ * Every file is read as the hash context @p ctx_of(size) says,
+ * on @p threads threads, and its full digest passed to @p on_digest.
+ *
+ * @return pairs of (prefix, larger file).
+ */
+template <class Container, class Sink, class ContextOf>
+auto prefix_search(const Container& size_map, Sink&& on_digest, ContextOf&& ctx_of, unsigned threads,
+                   std::uint64_t min_size = 1<<12)
+{
+    struct file_info {
+        const std::string *path;
+        std::uint64_t size;
+        std::optional<xxh::hash128_t> digest; // nothing if unreadable
+        std::vector<xxh::hash128_t> at_pow;   // at every power of two up to the size
+        std::vector<std::size_t> candidates;  // registered files needing a checkpoint
+        std::vector<std::size_t> prefixes;
+    };
+    using key_type = std::tuple<std::uint64_t, std::uint64_t, std::uint64_t>;
+    auto key = [](std::uint64_t len, const xxh::hash128_t& h) { return key_type{len, h.high64, h.low64}; };
+
+    std::vector<file_info> files;
+    std::vector<std::uint64_t> pows;
+    for (const auto& [size, paths]: size_map)
+        for (const auto& p: paths) {
+            files.push_back({&p, size, {}, {}, {}, {}});
+            if (size >= min_size)
+                pows.push_back(std::bit_floor(size));
+        }
+    ranges::sort(pows);
+    pows.erase(ranges::unique(pows).begin(), pows.end());
+
+    parallel_for(files.size(), threads, [&](std::size_t i) {
+        auto& f = files[i];
+        const auto& ctx = ctx_of(f.size);
+        const auto count = static_cast<std::size_t>(ranges::upper_bound(pows, f.size) - pows.begin());
+        std::vector<std::uint64_t> lengths(pows.begin(), pows.begin() + count);
+        if (lengths.empty() || lengths.back() != f.size)
+            lengths.push_back(f.size);
+
+        std::optional<std::vector<xxh::hash128_t>> digests;
+        if (lengths.size() == 1)
+            if (auto d = known_digest(*f.path, f.size, ctx))
+                digests.emplace(1, *d);
+        if (!digests) {
+            const auto mtime = ctx.cache ? dfs::index::file_mtime(*f.path) : 0;
+            if (!(digests = digests_at(*f.path, lengths, ctx)))
+                return; // unreadable, or changed since the search
+            if (ctx.cache)
+                ctx.cache->store(*f.path, {f.size, mtime, digests->back(), std::nullopt, {}});
+        }
+        f.digest = digests->back();
+        digests->resize(count);
+        f.at_pow = std::move(*digests);
+    });
+
+    std::map<key_type, std::vector<std::size_t>> registry;
+    for (std::size_t i=0; i<files.size(); i++)
+        if (const auto& f = files[i]; f.digest) {
+            on_digest(*f.path, *f.digest);
+            if (f.size >= min_size)
+                registry[key(std::bit_floor(f.size), f.at_pow.back())].push_back(i);
+        }
+
+    for (auto& f: files)
+        for (std::size_t k=0; k<f.at_pow.size() && pows[k] < f.size; k++)
+            if (auto it = registry.find(key(pows[k], f.at_pow[k])); it != registry.end())
+                for (auto j: it->second) {
+                    if (files[j].size == pows[k])
+                        f.prefixes.push_back(j);
+                    else if (files[j].size < f.size)
+                        f.candidates.push_back(j);
+                }
+
+    parallel_for(files.size(), threads, [&](std::size_t i) {
+        auto& f = files[i];
+        if (f.candidates.empty())
+            return;
+        std::vector<std::uint64_t> lengths;
+        for (auto j: f.candidates)
+            lengths.push_back(files[j].size);
+        ranges::sort(lengths);
+        lengths.erase(ranges::unique(lengths).begin(), lengths.end());
+        if (auto digests = digests_at(*f.path, lengths, ctx_of(f.size)))
+            for (auto j: f.candidates)
+                if ((*digests)[ranges::lower_bound(lengths, files[j].size) - lengths.begin()] == files[j].digest)
+                    f.prefixes.push_back(j);
+    });
+
+    std::vector<std::pair<std::string, std::string>> found;
+    for (auto& f: files) {
+        ranges::sort(f.prefixes);
+        for (auto j: f.prefixes)
+            found.emplace_back(*files[j].path, *f.path);
+    }
+    return found;
+}
+
+/**
+ * @brief Call @p f(i) for every i in [0, @p n) in parallel,
+ *        and @p done(i) on this thread in the order of i
+ *        as soon as f(i) has returned.
+ *
+ * Every i belongs to the lane @p lane[i], which has @p threads[lane[i]]
+ * threads of its own, so that long calls in one lane do not hold up
+ * the calls in another.
+ * An exception from any f(i) stops the work and is rethrown here.
+ */
+template <class F, class G>
+void parallel_ordered(std::size_t n, std::span<const unsigned char> lane, std::span<const unsigned> threads,
+                      F&& f, G&& done)
+{
+    std::vector<std::vector<std::size_t>> todo(threads.size());
+    for (std::size_t i=0; i<n; i++)
+        todo[lane[i]].push_back(i);
+
+    std::vector<std::atomic<std::size_t>> next(threads.size());
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<char> finished(n);
+    std::exception_ptr error;
+    std::atomic<bool> failed{false};
+
+    std::vector<std::jthread> pool;
+    for (std::size_t l=0; l<threads.size(); l++)
+        for (std::size_t t=0; t<std::min<std::size_t>(std::max(1u, threads[l]), todo[l].size()); t++)
+            pool.emplace_back([&, l] {
+                for (std::size_t k; !failed && (k = next[l]++) < todo[l].size(); ) {
+                    const auto i = todo[l][k];
+                    try { f(i); }
+                    catch (...) {
+                        std::lock_guard lock(mutex);
+                        if (!error)
+                            error = std::current_exception();
+                        failed = true;
+                        cv.notify_one();
+                        return;
+                    }
+                    std::lock_guard lock(mutex);
+                    finished[i] = 1;
+                    cv.notify_one();
+                }
+            });
+
+    for (std::size_t i=0; i<n; i++) {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [&] { return finished[i] != 0 || error; });
+        if (error)
+            std::rethrow_exception(error);
+        lock.unlock();
+        done(i);
+    }
+}
+
+/**
+ * @brief Find compressed files in @p size_map with equal decompressed content.
+ *
+ * Algorithm:
+ * 1. Key every gzip or zstd file by its recorded uncompressed size (mod 2^32).
+ * 2. Decompress in parallel, hashing the output, all files without
+ *    a recorded size, then all keyed files sharing their key with another.
+ * 3. Group them by decompressed size and digest.
+ * 4. Drop the groups whose files are all identical,
+ *    which the ordinary search reports already.
+ *
+ * Every file is read as the hash context @p ctx_of(size) says,
+ * on @p threads threads.
+ *
+ * @return the groups with their decompressed size.
+ */
+template <class Container, class ContextOf>
+auto decompressed_search(const Container& size_map, ContextOf&& ctx_of, unsigned threads)
+{
+    namespace dc = dfs::decompress;
+    struct item {
+        const std::string *path;
+        std::uint64_t size;
+        dc::format fmt;
+        std::optional<std::uint32_t> key;
+        std::optional<dc::content> res;
+    };
+
+    std::vector<item> items;
+    for (const auto& [size, paths]: size_map)
+        for (const auto& p: paths)
+            if (auto fmt = dc::detect(p); fmt != dc::format::none)
+                items.push_back({&p, size, fmt, dc::size_key(p, fmt, size), std::nullopt});
+
+    auto decompress = [&](const std::vector<std::size_t>& todo) {
+        parallel_for(todo.size(), threads, [&](std::size_t i) {
+            auto& it = items[todo[i]];
+            it.res = paced_read(ctx_of(it.size), *it.path, [&](auto&& on_read) {
+                return dc::hash_content(*it.path, it.fmt, on_read);
+            });
+        });
+    };
+
+    std::vector<std::size_t> todo;
+    for (std::size_t i=0; i<items.size(); i++)
+        if (!items[i].key)
+            todo.push_back(i);
+    decompress(todo);
+
+    std::map<std::uint32_t, std::size_t> keys;
+    for (const auto& it: items)
+        if (it.key)
+            keys[*it.key]++;
+        else if (it.res)
+            keys[static_cast<std::uint32_t>(it.res->size)]++;
+
+    todo.clear();
+    for (std::size_t i=0; i<items.size(); i++)
+        if (items[i].key && keys[*items[i].key] > 1)
+            todo.push_back(i);
+    decompress(todo);
+
+    std::map<std::tuple<std::uint64_t, std::uint64_t, std::uint64_t>, std::vector<std::size_t>> map;
+    for (std::size_t i=0; i<items.size(); i++)
+        if (const auto& r = items[i].res)
+            map[{r->size, r->digest.high64, r->digest.low64}].push_back(i);
+
+    std::vector<std::pair<std::uint64_t, std::vector<std::string>>> res;
+    for (auto& [k, members]: map)
+        if (ranges::any_of(members, [&](auto i) { return items[i].res->raw != items[members[0]].res->raw; }))
+        {
+            std::vector<std::string> paths;
+            for (auto i: members)
+                paths.push_back(*items[i].path);
+            res.emplace_back(std::get<0>(k), std::move(paths));
+        }
+    return res;
+}
+
+/**
+ * @brief Find text files in @p size_map that are equal once normalized,
+ *        but not byte for byte.
+ *
+ * Algorithm:
+ * 1. Read every file once in parallel, hashing its normalized text
+ *    and keying it by the normalized length, both in the same pass.
+ *    Files with a NUL byte are binary and left out.
+ * 2. Group them by normalized length and digest.
+ * 3. Drop the groups whose files are all identical,
+ *    which the ordinary search reports already.
+ *
+ * Every file is read as the hash context @p ctx_of(size) says,
+ * on @p threads threads.
+ *
+ * @return the groups with their normalized length.
+ */
+template <class Container, class ContextOf>
+auto text_search(const Container& size_map, ContextOf&& ctx_of, unsigned threads)
+{
+    std::vector<const std::string*> files;
+    std::vector<std::uint64_t> sizes;
+    for (const auto& [size, paths]: size_map)
+        for (const auto& p: paths) {
+            files.push_back(&p);
+            sizes.push_back(size);
+        }
+
+    std::vector<std::optional<dfs::text::normalized>> res(files.size());
+    parallel_for(files.size(), threads, [&](std::size_t i) {
+        res[i] = paced_read(ctx_of(sizes[i]), *files[i], [&](auto&& on_read) {
+            return dfs::text::hash_file(*files[i], on_read);
+        });
+    });
+
+    using key_type = std::tuple<std::uint64_t, std::uint64_t, std::uint64_t>;
+    std::map<key_type, std::vector<std::size_t>> map;
+    for (std::size_t i=0; i<files.size(); i++)
+        if (res[i])
+            map[{res[i]->length, res[i]->digest.high64, res[i]->digest.low64}].push_back(i);
+
+    std::vector<std::pair<std::uint64_t, std::vector<std::string>>> groups;
+    for (const auto& [key, members]: map)
+        if (ranges::any_of(members, [&](auto i) { return res[i]->raw != res[members[0]]->raw; }))
+        {
+            std::vector<std::string> paths;
+            for (auto i: members)
+                paths.push_back(*files[i]);
+            groups.emplace_back(std::get<0>(key), std::move(paths));
+        }
+    return groups;
+}
+
+/**
+ * @brief Find files in @p size_map contained whole in larger files,
+ *        at any offset.
+ *
+ * Algorithm:
+ * 1. Key every file of at least a window (4 KiB) by the rolling hash of
+ *    its first window, and keep a hash of its last bytes. Files whose
+ *    first window is one byte repeated are left out: they would seem
+ *    to start almost anywhere in a disk image.
+ * 2. Read every file larger than the smallest keyed one once, in parallel,
+ *    rolling the hash over all its windows with one table for all keys.
+ * 3. Where a keyed file may start and fits, compare the last bytes there,
+ *    then the digest of the whole span with that of the file.
+ *    A file is reported at its first offset in every larger file,
+ *    and given up in a larger file after too many false starts: there,
+ *    a file whose first window recurs often before the file itself,
+ *    such as a run of one pattern, may be missed.
+ *
+ * Every file is read as the hash context @p ctx_of(size) says,
+ * on @p threads threads.
+ *
+ * @return triples of (contained file, larger file, offset).
+ */
+template <class Container, class ContextOf>
+auto containment_search(const Container& size_map, ContextOf&& ctx_of, unsigned threads)
+{
+    namespace contain = dfs::contain;
+    constexpr std::size_t tail = 256;
+    constexpr unsigned max_false_starts = 16;
+    struct candidate {
+        const std::string *path = nullptr;
+        std::uint64_t size = 0;
+        std::optional<std::uint64_t> key; // the hash of the first window
+        std::uint64_t tail_hash = 0;
+        std::once_flag once;
+        std::optional<xxh::hash128_t> digest;
+    };
+
+    std::vector<std::pair<const std::string*, std::uint64_t>> files;
+    for (const auto& [size, paths]: size_map)
+        for (const auto& p: paths)
+            files.emplace_back(&p, size);
+    if (files.empty())
+        return std::vector<std::tuple<std::string, std::string, std::uint64_t>>{};
+
+    const auto first = ranges::lower_bound(files, contain::window, {}, [](const auto& f) { return f.second; });
+    const auto largest = files.back().second;
+    const auto keyed = static_cast<std::size_t>(ranges::lower_bound(first, files.end(), largest, {},
+                                                                    [](const auto& f) { return f.second; }) - first);
+    // Read @p fin at an offset, paced and counted as @p ctx says.
+    auto reader = [](dfs::input_file& fin, const hash_context& ctx, std::size_t mount) {
+        return [&fin, &ctx, mount, paced = std::chrono::steady_clock::now()]
+               (char *p, std::size_t n, std::uint64_t at) mutable {
+            if (ctx.pacer)
+                paced = ctx.pacer->throttle(paced);
+            if (ctx.metrics)
+                ctx.metrics->read(mount, n);
+            return fin.read_at(p, n, at);
+        };
+    };
+
+    std::vector<candidate> cands(keyed);
+    parallel_for(keyed, threads, [&](std::size_t i) {
+        auto& c = cands[i];
+        std::tie(c.path, c.size) = first[i];
+        unsigned char buf[contain::window];
+        const auto& ctx = ctx_of(c.size);
+        const auto mount = ctx.mount_of(*c.path);
+        read_slot slot(ctx, mount);
+        dfs::input_file fin(*c.path, ctx.dirs);
+        if (ctx.metrics)
+            ctx.metrics->read(mount, contain::window + tail);
+        if (!fin.read_at(reinterpret_cast<char*>(buf), contain::window, 0)
+            || ranges::all_of(buf, [&](unsigned char b) { return b == buf[0]; }))
+            return;
+        c.key = contain::hash(buf);
+        if (fin.read_at(reinterpret_cast<char*>(buf), tail, c.size - tail))
+            c.tail_hash = xxh::xxhash3<64>(buf, tail);
+        else
+            c.key.reset();
+    });
+
+    contain::table table;
+    std::uint64_t smallest = largest;
+    for (std::uint32_t i=0; i<cands.size(); i++)
+        if (cands[i].key) {
+            table.add(*cands[i].key, i);
+            smallest = std::min(smallest, cands[i].size);
+        }
+
+    // Whether the @p c.size bytes of @p read_at at @p offset are those of @p c,
+    // read in the read slot held for them.
+    auto confirm = [&](auto& read_at, std::uint64_t offset, candidate& c) {
+        char buf[tail];
+        if (!read_at(buf, tail, offset + c.size - tail) || xxh::xxhash3<64>(buf, tail) != c.tail_hash)
+            return false;
+        std::call_once(c.once, [&] {
+            const auto& ctx = ctx_of(c.size);
+            dfs::input_file own(*c.path, ctx.dirs);
+            c.digest = contain::span_digest(reader(own, ctx, ctx.mount_of(*c.path)), 0, c.size);
+        });
+        return c.digest && contain::span_digest(read_at, offset, c.size) == c.digest;
+    };
+
+    const auto large = ranges::upper_bound(files, smallest, {}, [](const auto& f) { return f.second; });
+    const auto count = table.empty() ? 0 : static_cast<std::size_t>(files.end() - large);
+    std::vector<std::tuple<std::string, std::string, std::uint64_t>> res;
+    std::mutex res_mutex;
+    parallel_for(count, threads, [&](std::size_t i) {
+        const auto& [path, size] = large[i];
+        const auto& ctx = ctx_of(size);
+        const auto mount = ctx.mount_of(*path);
+        read_slot slot(ctx, mount);
+        dfs::input_file fin(*path, ctx.dirs);
+        if (!fin)
+            return;
+        auto read_at = reader(fin, ctx, mount);
+        auto paced = std::chrono::steady_clock::now();
+        std::unordered_map<std::uint32_t, unsigned> false_starts;
+        std::unordered_set<std::uint32_t> found;
+        decltype(res) local;
+        contain::scan([&](char *p, std::size_t n) {
+                if (ctx.pacer)
+                    paced = ctx.pacer->throttle(paced);
+                const auto got = fin.read(p, n);
+                if (ctx.metrics)
+                    ctx.metrics->read(mount, got);
+                return got;
+            }, table,
+            [&](std::uint64_t offset, std::uint32_t id) {
+                auto& c = cands[id];
+                if (c.size >= size || offset + c.size > size || found.contains(id))
+                    return;
+                if (auto& fails = false_starts[id]; fails < max_false_starts) {
+                    if (confirm(read_at, offset, c)) {
+                        found.insert(id);
+                        local.emplace_back(*c.path, *path, offset);
+                    }
+                    else
+                        fails++;
+                }
+            });
+        std::lock_guard lock(res_mutex);
+        ranges::move(local, std::back_inserter(res));
+    });
+    return res;
+}
+
+/**
+ * @brief Search @p dir recursively for all regular files, sorted by size,
+ *        counting them in @p metrics.
  *
  * @return a pair of the numbers of non-empty files ans all regular files.
  */
 template <class Container>
-auto search(const fs::path& dir, Container& size_map)
+auto search(const fs::path& dir, const dfs::mounts::table& mounts, Container& size_map, search_metrics& metrics)
 {
     std::size_t tot=0, empty=0;
     std::size_t tot_size=0;
 
     std::println("Empty file list:");
 
-    for (const auto& entry: fs::recursive_directory_iterator{dir})
-      if (entry.is_regular_file())
-      {
+    dfs::walk(dir, mounts, [&](const fs::path& path, std::uint64_t size) {
         tot++;
-        auto path_str = entry.path().generic_string();
-        if (entry.file_size()) {
-            tot_size += entry.file_size();
-            size_map[entry.file_size()].emplace_back(path_str);
+        metrics.files_scanned.add();
+        metrics.scanned_bytes.add(size);
+        auto path_str = path.generic_string();
+        if (size) {
+            tot_size += size;
+            size_map[size].emplace_back(path_str);
         }
         else {
             empty++;
             std::println("{}", path_str);
         }
-      }
+    });
 
     std::println("\nEmpty: {}\nTotal: {}\nSize:  {}\n", empty, tot, prettify_bytes(tot_size));
 
@@ -167,67 +1376,666 @@ auto search(const fs::path& dir, Container& size_map)
 }
 
 /**
- * @brief Search @p dirpath for duplicate files.
+ * @brief The entries of the git indices among the files in @p size_map,
+ *        keyed by the path of their file in the work tree.
+ *
+ * Only indices in .git directories count, of repositories whose work
+ * tree is where the .git directory is; damaged ones are skipped.
+ */
+template <class Container>
+auto git_blobs(const Container& size_map)
+{
+    std::unordered_map<std::string, dfs::git::entry> blobs;
+    for (const auto& paths: size_map | views::values)
+        for (const auto& p: paths)
+            if (p.ends_with("/.git/index") || p == ".git/index") {
+                const auto git_dir = fs::path(p).parent_path();
+                try {
+                    blobs.merge(dfs::git::read_index(git_dir, git_dir.parent_path()));
+                }
+                catch (const std::exception& e) {
+                    std::println(stderr, "Skipping {}: {}", p, e.what());
+                }
+            }
+    return blobs;
+}
+
+/**
+ * @brief Group the files of @p size_map by name, and by mtime if asked,
+ *        within their size group, and output the groups of several files.
+ *
+ * No file is read, except for the @p opt.verify_top groups of the most
+ * redundant bytes: these are checked by content and output as the groups
+ * of equal files within them, marked as verified.
+ */
+template <class Container>
+void heuristic_search(const options& opt, const dfs::mounts::table& mounts, Container& size_map,
+                      search_metrics& stats)
+{
+    struct group {
+        std::uint64_t size;
+        std::vector<std::string> paths;
+        bool verified = false;
+    };
+    std::vector<group> groups;
+
+    for (auto& [size, paths]: size_map)
+    {
+        if (paths.size() < 2) {
+            stats.eliminated[search_metrics::by_size].add(paths.size());
+            continue;
+        }
+        std::map<std::pair<std::string_view, std::int64_t>, std::vector<std::string>> keys;
+        for (auto& p: paths) {
+            const auto slash = p.rfind('/');
+            std::string_view name = slash == std::string::npos ? p : std::string_view(p).substr(slash+1);
+            const auto mtime = opt.heuristic_mtime ? dfs::index::file_mtime(p) : 0;
+            keys[{name, mtime}].push_back(p); // a copy, as the key views it
+        }
+        for (auto& files: keys | views::values)
+            if (files.size() > 1)
+                groups.push_back({size, std::move(files)});
+    }
+
+    // The groups of most redundant bytes first, for verification.
+    std::vector<std::size_t> top(groups.size());
+    for (std::size_t i=0; i<top.size(); i++)
+        top[i] = i;
+    const auto n = std::min<std::size_t>(opt.verify_top, top.size());
+    ranges::partial_sort(top, top.begin() + n, ranges::greater{},
+                         [&](auto i) { return groups[i].size * (groups[i].paths.size() - 1); });
+    top.resize(n);
+
+    dfs::dir_cache dirs(dfs::dir_cache::default_budget());
+    const hash_context ctx{nullptr, nullptr, &mounts, {}, opt.tune.bufsize, &stats, 0, false, &dirs};
+    std::vector<std::vector<std::vector<std::string>>> verified(n);
+    parallel_for(n, opt.tune.threads, [&](std::size_t k) {
+        hash_check(groups[top[k]].paths, verified[k], ignore_digest{}, ctx);
+    });
+    for (std::size_t k=0; k<n; k++) {
+        const auto size = groups[top[k]].size;
+        groups[top[k]].paths.clear(); // replaced by its groups of equal files
+        for (auto& files: verified[k])
+            groups.push_back({size, std::move(files), true});
+    }
+    std::erase_if(groups, [](const group& g) { return g.paths.empty(); });
+    ranges::stable_sort(groups, {}, &group::size);
+
+    std::size_t num = 0;
+    std::uintmax_t rdsize = 0;
+    for (auto& [size, paths, checked]: groups) {
+        num++;
+        rdsize += size * (paths.size()-1);
+        dfs::radix::sort(paths, {}, opt.tune.threads);
+        std::println(" #{} [{}]  {}{}", num, paths.size(), prettify_bytes(size), checked ? "  verified" : "");
+        for (const auto& p: paths)
+            // This needs to be enforced on Windows.
+            std::vprint_nonunicode("{}\n", std::make_format_args(p));
+        std::println("");
+    }
+
+    std::println("Grouped by size and name{}, {} of the groups verified by content.\n",
+                 opt.heuristic_mtime ? " and mtime" : "", n);
+    std::println("Redundant data size: {}\n\nDone in {:.3f}s.",
+                    prettify_bytes(rdsize) , (double)clock()/CLOCKS_PER_SEC);
+}
+
+/**
+ * @brief Print the plan of every size group of @p jobs, compared with
+ *        the context of its lane in @p lane_ctx, and its predicted cost.
+ *
+ * No file is read, digests are only looked up. Reflinked and stored
+ * copies are not taken out first, so their groups may be planned larger.
+ */
+template <class Jobs>
+void explain(const Jobs& jobs, std::span<const hash_context> lane_ctx, std::uint64_t large_min)
+{
+    namespace planner = dfs::planner;
+    auto time = [](double s) {
+        return s < 1 ? std::format("{:.3g} ms", s * 1e3) : std::format("{:.3g} s", s);
+    };
+    std::size_t chosen[planner::strategies] {};
+    double total = 0;
+    std::size_t num = 0;
+
+    for (const auto& job: jobs)
+    {
+        const auto& ctx = lane_ctx[job.filesize >= large_min];
+        std::vector<std::string> unread;
+        std::size_t known = 0;
+        bool known_blocks = ctx.blocks && ctx.cache && job.filesize > dfs::hash_cache::block_size;
+        for (const auto& p: job.paths)
+            if (auto hash = known_digest(p, job.filesize, ctx)) {
+                known++;
+                if (auto e = known_blocks ? ctx.cache->find(p) : std::nullopt; !e || e->digest != *hash || e->blocks.empty())
+                    known_blocks = false;
+            }
+            else
+                unread.push_back(p);
+
+        const auto plan = plan_group(job.filesize, unread, known, known_blocks, ctx);
+        chosen[static_cast<std::size_t>(plan.how)]++;
+        total += plan.seconds;
+        std::string costs;
+        for (std::size_t i=0; i<planner::strategies; i++)
+            if (std::isfinite(plan.costs[i]))
+                costs += std::format("{}{} {}", costs.empty() ? "" : ", ", planner::names[i], time(plan.costs[i]));
+        std::println(" #{} [{}]  {}  {}  ({})", ++num, job.paths.size(), prettify_bytes(job.filesize),
+                     planner::name(plan.how), costs);
+    }
+
+    std::string counts;
+    for (std::size_t i=0; i<planner::strategies; i++)
+        counts += std::format("{}{} {}", i ? ", " : "", planner::names[i], chosen[i]);
+    std::println("\nPlans: {}\nPredicted: {} of reading and hashing on one thread.", counts, time(total));
+}
+
+/**
+ * @brief Search @p opt.dir for duplicate files.
  *
  * Algorithm:
- * 1. Search @p dirpath recursively for all regular files.
+ * 1. Search @p opt.dir recursively for all regular files.
  * 2. Group files by size, with empty files directly output.
  * 3. For each group of multiple files, group them by hashing.
- * 4. If an ultimate group is multiple, output it.
+ *    Size groups are hashed on @p opt.tune.threads threads,
+ *    with at most @p opt.tune.queue_depth files being read at once,
+ *    scaled per mount by the policy of its filesystem type.
+ *    With @p opt.pace, both back off while the system is under pressure.
+ *    Both are split between a lane of small and a lane of large files.
+ *    Reflinked copies, copies in content-addressed stores
+ *    and unmodified git-tracked files of the same blob
+ *    are taken out before and put back after,
+ *    and larger files may be read in the order of their disk location.
+ *    How each group is compared is planned by a cost model, see hash_check.
+ * 4. If an ultimate group is multiple, output it, in size order.
+ * 5. If requested, write all files and digests into an index,
+ *    and a sample of the contents into a sketch.
+ * With a heuristic, step 3 groups by metadata instead, see heuristic_search.
  */
-void duplicate_file_search(const fs::path dirpath)
+void duplicate_file_search(const options& opt)
 {
+    constexpr std::uint64_t physical_order_min = 1<<16; // 64 KiB
+    const dfs::mounts::table mounts(opt.dir);
+    search_metrics stats;
+    dfs::metrics::registry registry;
+    std::optional<dfs::metrics::exporter> exporter;
+    if (!opt.metrics.empty()) {
+        stats.describe(registry, mounts, opt.dir);
+        exporter.emplace(registry, opt.metrics);
+    }
     std::map<std::uint64_t, std::vector<std::string>> size_map;
-    search(dirpath, size_map);
+    search(opt.dir, mounts, size_map, stats);
+    if (opt.heuristic) {
+        heuristic_search(opt, mounts, size_map, stats);
+        return;
+    }
+    std::unordered_map<std::string, dfs::git::entry> blobs;
+    if (opt.git)
+        blobs = git_blobs(size_map);
+    // The key of a file known without reading it, if any.
+    auto key_of = [&](const std::string& p) -> std::optional<dfs::cas::matcher::match> {
+        if (auto m = opt.cas.find(p))
+            return m;
+        if (auto it = blobs.find(p); it != blobs.end() && dfs::git::unmodified(p, it->second))
+            return dfs::cas::matcher::match{"git:" + it->second.oid};
+        return std::nullopt;
+    };
     std::size_t num=0;
     std::uintmax_t rdsize=0; // redundant data size
 
+    std::optional<dfs::index::builder> index;
+    if (!opt.index.empty())
+        index.emplace();
+    std::optional<dfs::hash_cache> cache;
+    if (!opt.cache.empty())
+        cache.emplace(opt.cache);
+    std::optional<dfs::index::reader> previous;
+    since_filter since;
+    if (!opt.since.empty()) {
+        if (fs::is_regular_file(opt.since)) {
+            previous.emplace(opt.since);
+            since.previous = &*previous;
+        }
+        else
+            since.time = parse_time(opt.since);
+    }
+    // Per lane, small and large files, and per mount.
+    const unsigned lane_threads[] {opt.tune.small_threads(), opt.tune.large_threads};
+    const unsigned lane_depth[] {opt.tune.small_queue_depth(), opt.tune.large_queue_depth};
+    std::vector<std::unique_ptr<std::counting_semaphore<>>> reads[2];
+    for (int l=0; l<2; l++)
+        for (const auto& m: mounts) {
+            const auto depth = lane_depth[l] * m.pol.queue_scale;
+            reads[l].push_back(depth && depth < lane_threads[l] ? std::make_unique<std::counting_semaphore<>>(depth) : nullptr);
+        }
+    for (int l=0; l<2; l++)
+        stats.queue_depth[l].set(lane_depth[l]);
+    dfs::dir_cache dirs(dfs::dir_cache::default_budget());
+    std::optional<dfs::pressure::pacer> pacer;
+    if (opt.pace > 0) {
+        pacer.emplace(opt.tune.threads, opt.pace);
+        if (!pacer->active())
+            std::println(stderr, "No pressure stall information, reading is not paced.");
+    }
+    const dfs::planner::model planner(opt.profile, mounts, opt.dir, opt.tune.bufsize);
+    const bool wanted = index || cache || !opt.sketch.empty(); // every digest
+    const hash_context lane_ctx[] {
+        {cache ? &*cache : nullptr, previous ? &*previous : nullptr, &mounts, reads[0], opt.tune.bufsize, &stats, 0,
+         opt.block_digests, &dirs, &planner, wanted, pacer ? &*pacer : nullptr},
+        {cache ? &*cache : nullptr, previous ? &*previous : nullptr, &mounts, reads[1], opt.tune.bufsize, &stats, 1,
+         opt.block_digests, &dirs, &planner, wanted, pacer ? &*pacer : nullptr},
+    };
+    // The context of the lane a file of some size is read in.
+    auto ctx_of = [&](std::uint64_t filesize) -> const hash_context& {
+        return lane_ctx[filesize >= opt.tune.large_min];
+    };
+
+    std::vector<std::pair<std::uint64_t, std::vector<std::string>>> decompressed;
+    if (opt.decompress)
+        decompressed = decompressed_search(size_map, ctx_of, opt.tune.threads);
+
+    std::vector<std::pair<std::uint64_t, std::vector<std::string>>> texts;
+    if (opt.text)
+        texts = text_search(size_map, ctx_of, opt.tune.threads);
+
+    std::vector<std::tuple<std::string, std::string, std::uint64_t>> contained;
+    if (opt.contained)
+        contained = containment_search(size_map, ctx_of, opt.tune.threads);
+
+    std::vector<std::pair<std::string, std::string>> prefixes;
+    std::unordered_map<std::string, xxh::hash128_t> digests;
+    if (opt.prefix)
+        prefixes = prefix_search(size_map, [&](const std::string& file, const xxh::hash128_t& digest) {
+            digests.emplace(file, digest);
+        }, ctx_of, opt.tune.threads);
+
+    struct job {
+        std::uint64_t filesize;
+        std::vector<std::string> paths;
+        std::unordered_set<std::string> news;
+        std::vector<std::vector<std::string>> res;
+    };
+    std::vector<job> jobs;
+
     for (auto&& pair: size_map)
     {
         const auto filesize = pair.first;
         auto paths = std::move(pair.second);
-        if (paths.size() <= 1)
+        if (index)
+            for (const auto& p: paths)
+                index->add(p, filesize);
+        if (paths.size() == 1)
+            stats.eliminated[search_metrics::by_size].add();
+        if (paths.size() <= 1 && !opt.full_digests)
             continue;
 
-        std::vector<std::vector<std::string>> res;
-        hash_check(std::move(paths), res);
+        // Only groups with a new file can hold a new duplicate.
+        std::unordered_set<std::string> news;
+        if (!opt.since.empty()) {
+            for (const auto& p: paths)
+                if (since.is_new(p, filesize))
+                    news.insert(p);
+            if (news.empty() && !opt.full_digests) {
+                stats.eliminated[search_metrics::by_since].add(paths.size());
+                continue;
+            }
+        }
+        jobs.push_back({filesize, std::move(paths), std::move(news), {}});
+    }
+
+    if (opt.explain) {
+        explain(jobs, lane_ctx, opt.tune.large_min);
+        return;
+    }
+
+    std::optional<dfs::sketch::sketch> sketch;
+    if (!opt.sketch.empty())
+        sketch.emplace();
+    std::mutex index_mutex;
+    auto on_digest = [&](const std::string& file, std::uint64_t filesize, const xxh::hash128_t& digest) {
+        if (index || sketch) {
+            std::lock_guard lock(index_mutex);
+            if (index)
+                index->set_digest(file, digest);
+            if (sketch)
+                sketch->add(filesize, digest);
+        }
+    };
+
+    stats.pending_groups.set(jobs.size());
+    std::vector<unsigned char> lane(jobs.size());
+    for (std::size_t i=0; i<jobs.size(); i++)
+        lane[i] = jobs[i].filesize >= opt.tune.large_min;
+
+    parallel_ordered(jobs.size(), lane, lane_threads, [&](std::size_t i) {
+        auto& [filesize, paths, news, res] = jobs[i];
+        const auto& ctx = lane_ctx[lane[i]];
+        if (opt.prefix || opt.full_digests) {
+            // Every file is hashed whole: by the prefix search already, or here.
+            std::map<std::pair<std::uint64_t, std::uint64_t>, std::vector<std::string>> map;
+            for (auto& p: paths) {
+                std::optional<xxh::hash128_t> digest;
+                if (!opt.prefix)
+                    digest = full_hash(p, filesize, ctx);
+                else if (auto it = digests.find(p); it != digests.end())
+                    digest = it->second;
+                if (digest) {
+                    on_digest(p, filesize, *digest);
+                    map[{digest->high64, digest->low64}].emplace_back(std::move(p));
+                }
+            }
+            for (auto& files: map | views::values)
+                if (files.size() > 1)
+                    res.emplace_back(std::move(files));
+        }
+        else {
+            auto clones = take_clones(paths, ctx);
+            for (const auto& c: clones | views::values)
+                stats.unread[search_metrics::clone].add(c.size());
+            if (!opt.cas.empty() || !blobs.empty())
+                for (auto& [original, copies]: take_known_copies(paths, filesize, key_of, opt.cas_checks, ctx)) {
+                    stats.unread[search_metrics::copy].add(copies.size());
+                    auto& all = clones[original];
+                    for (auto& c: copies) {
+                        // with the reflinked clones of the copy
+                        if (auto node = clones.extract(c))
+                            ranges::move(node.mapped(), std::back_inserter(all));
+                        all.push_back(std::move(c));
+                    }
+                }
+            if (filesize >= physical_order_min)
+                if (ranges::any_of(paths, [&](const auto& p) { return ctx.policy(ctx.mount_of(p)).physical_order; })) {
+                    std::vector<std::pair<std::uint64_t, std::string>> order;
+                    for (auto& p: paths)
+                        order.emplace_back(dfs::mounts::physical_offset(p), std::move(p));
+                    ranges::stable_sort(order, {}, &decltype(order)::value_type::first);
+                    paths.clear();
+                    for (auto& p: order | views::values)
+                        paths.push_back(std::move(p));
+                }
+
+            hash_check(std::move(paths), res, [&](const std::string& file, const xxh::hash128_t& digest) {
+                on_digest(file, filesize, digest);
+                if (auto it = clones.find(file); it != clones.end())
+                    for (const auto& c: it->second)
+                        on_digest(c, filesize, digest);
+            }, ctx);
+
+            // A reflinked or stored copy is in the group of its original, or forms one with it.
+            for (auto& files: res)
+                for (std::size_t k=0, n=files.size(); k<n; k++)
+                    if (auto it = clones.find(files[k]); it != clones.end()) {
+                        ranges::move(it->second, std::back_inserter(files));
+                        clones.erase(it);
+                    }
+            for (auto& [original, copies]: clones) {
+                copies.insert(copies.begin(), original);
+                res.emplace_back(std::move(copies));
+            }
+        }
+    },
+    [&](std::size_t i) {
+        auto& [filesize, paths, news, res] = jobs[i];
         for (auto&& paths: res) {
+            if (!opt.since.empty() && ranges::none_of(paths, [&](const auto& p) { return news.contains(p); }))
+                continue;
+            DFS_PROBE(group_confirmed, filesize, paths.size());
             num++;
             rdsize += filesize * (paths.size()-1);
-            ranges::sort(paths);
+            dfs::radix::sort(paths, {}, opt.tune.threads);
             std::println(" #{} [{}]  {}", num, paths.size(), prettify_bytes(filesize));
             for (const auto& p: paths)
                 // This needs to be enforced on Windows.
                 std::vprint_nonunicode("{}\n", std::make_format_args(p));
             std::println("");
         }
+        jobs[i] = {};
+        stats.pending_groups.sub();
+    });
+
+    if (opt.decompress) {
+        std::println("Same content when decompressed: {}\n", decompressed.size());
+        std::size_t dnum = 0;
+        for (auto& [size, paths]: decompressed) {
+            dfs::radix::sort(paths, {}, opt.tune.threads);
+            std::println(" #{} [{}]  {} decompressed", ++dnum, paths.size(), prettify_bytes(size));
+            for (const auto& p: paths)
+                std::vprint_nonunicode("{}\n", std::make_format_args(p));
+            std::println("");
+        }
+    }
+
+    if (opt.text) {
+        std::println("Same text when normalized: {}\n", texts.size());
+        std::size_t tnum = 0;
+        for (auto& [length, paths]: texts) {
+            dfs::radix::sort(paths, {}, opt.tune.threads);
+            std::println(" #{} [{}]  {} normalized", ++tnum, paths.size(), prettify_bytes(length));
+            for (const auto& p: paths)
+                std::vprint_nonunicode("{}\n", std::make_format_args(p));
+            std::println("");
+        }
+    }
+
+    if (opt.prefix) {
+        ranges::sort(prefixes);
+        std::println("Prefix copies: {}\n", prefixes.size());
+        for (const auto& [part, whole]: prefixes)
+            std::vprint_nonunicode("{}\n  is a prefix of {}\n", std::make_format_args(part, whole));
+        std::println("");
+    }
+
+    if (opt.contained) {
+        ranges::sort(contained);
+        std::println("Contained copies: {}\n", contained.size());
+        for (const auto& [part, whole, offset]: contained)
+            std::vprint_nonunicode("{}\n  is contained in {} at offset {}\n", std::make_format_args(part, whole, offset));
+        std::println("");
     }
 
+    if (index)
+        index->write(opt.index);
+    if (sketch)
+        sketch->write(opt.sketch);
+    if (cache)
+        cache->save();
+
     std::println("Redundant data size: {}\n\nDone in {:.3f}s.",
                     prettify_bytes(rdsize) , (double)clock()/CLOCKS_PER_SEC);
 }
 
+void usage()
+{
+    std::println("Usage: dfsearch [options] [directory]\n\n"
+                 "Options:\n"
+                 "  --index <file>   write a queryable index of the files and digests\n"
+                 "  --cache <file>   reuse and keep digests of unchanged or appended files\n"
+                 "  --block-digests  also cache a digest of every 1 MiB of large files, so that\n"
+                 "                   new files are compared against cached ones as they are read\n"
+                 "  --prefix         also find files that are truncated copies of others\n"
+                 "  --contained      also find files of 4 KiB or more found whole inside\n"
+                 "                   larger files, such as archives or disk images; a file\n"
+                 "                   may be missed where its first 4 KiB recur many times\n"
+                 "  --since <t|idx>  only report duplicates of files changed after a UTC time\n"
+                 "                   (YYYY-MM-DD[THH:MM[:SS]] or @seconds) or not in an index\n"
+                 "  --decompress     also find gzip/zstd files with equal decompressed content\n"
+                 "  --text           also find text files differing only in line endings\n"
+                 "                   or trailing whitespace\n"
+                 "  --full-digests   hash every file, also those of unique size, so that\n"
+                 "                   indices can be compared and merged with dfquery\n"
+                 "  --sketch <file>  write a fixed-size sample of the contents, to estimate\n"
+                 "                   the bytes shared with other hosts by dfquery overlap;\n"
+                 "                   implies --full-digests\n"
+                 "  --cas            group files in content-addressed stores (OCI blobs, Bazel,\n"
+                 "                   pnpm, ...) by the digest in their path, unread\n"
+                 "  --cas-pattern <regex>  add a store whose digest is the regex's first group\n"
+                 "  --git            group unmodified tracked files of git work trees by the\n"
+                 "                   blob ids in their index, unread\n"
+                 "  --cas-check <n>  verify a store or blob group by hashing n of its copies\n"
+                 "  --heuristic=name+size[+mtime]  group files by size and name, and mtime,\n"
+                 "                   reading no data; other content options are ignored\n"
+                 "  --verify-top <n> verify the n heuristic groups of most redundant bytes\n"
+                 "                   by content\n"
+                 "  --explain        print how every size group would be compared, and the\n"
+                 "                   predicted cost, instead of searching\n"
+                 "  --threads <n>    hash with n threads instead of the tuned number\n"
+                 "  --pace <percent> read fewer files at once, down to one read part of the\n"
+                 "                   time, while tasks stall on I/O or CPU more than this\n"
+                 "                   share of the time (Linux pressure stall information)\n"
+                 "  --metrics <file|unix:path>  export live counters in OpenMetrics format,\n"
+                 "                   rewriting a file every 5s or serving a Unix socket\n"
+                 "  --calibrate      measure the hash and read rates of the directory's device\n"
+                 "                   and save them as the tuning profile for later runs");
+}
+
 int main(int argc, char *argv[])
 {
-    fs::path dir;
+    options opt;
+    unsigned threads = 0;
+    bool calibrate = false;
+    bool builtin_cas = false;
 
-    if (argc <= 1) {
-        dir = ".";
-    }
-    else {
-        dir = argv[1];
-        if (!fs::exists(dir) || !fs::is_directory(dir))
-        {
-            std::println("No such directory.");
+    for (int i=1; i<argc; i++)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--index" && i+1 < argc)
+            opt.index = argv[++i];
+        else if (arg == "--cache" && i+1 < argc)
+            opt.cache = argv[++i];
+        else if (arg.starts_with("--heuristic=") || (arg == "--heuristic" && i+1 < argc)) {
+            std::string_view keys = arg == "--heuristic" ? std::string_view(argv[++i]) : arg.substr(12);
+            if (keys == "name+size" || keys == "size+name")
+                opt.heuristic = true;
+            else if (keys == "name+size+mtime" || keys == "size+name+mtime") {
+                opt.heuristic = true;
+                opt.heuristic_mtime = true;
+            }
+            else {
+                usage();
+                return 1;
+            }
+        }
+        else if (arg == "--verify-top" && i+1 < argc) {
+            std::string_view v = argv[++i];
+            if (std::from_chars(v.data(), v.data()+v.size(), opt.verify_top).ec != std::errc{}) {
+                usage();
+                return 1;
+            }
+        }
+        else if (arg == "--block-digests")
+            opt.block_digests = true;
+        else if (arg == "--since" && i+1 < argc)
+            opt.since = argv[++i];
+        else if (arg == "--text")
+            opt.text = true;
+        else if (arg == "--decompress")
+            opt.decompress = true;
+        else if (arg == "--prefix")
+            opt.prefix = true;
+        else if (arg == "--contained")
+            opt.contained = true;
+        else if (arg == "--cas") {
+            if (!builtin_cas) {
+                opt.cas.add_builtins();
+                builtin_cas = true;
+            }
+        }
+        else if (arg == "--git")
+            opt.git = true;
+        else if (arg == "--cas-pattern" && i+1 < argc) {
+            try { opt.cas.add(argv[++i]); }
+            catch (const std::regex_error& e) {
+                std::println("Invalid --cas-pattern: {}", e.what());
+                return 1;
+            }
+        }
+        else if (arg == "--cas-check" && i+1 < argc) {
+            std::string_view v = argv[++i];
+            if (std::from_chars(v.data(), v.data()+v.size(), opt.cas_checks).ec != std::errc{}) {
+                usage();
+                return 1;
+            }
+        }
+        else if (arg == "--sketch" && i+1 < argc) {
+            opt.sketch = argv[++i];
+            opt.full_digests = true;
+        }
+        else if (arg == "--metrics" && i+1 < argc)
+            opt.metrics = argv[++i];
+        else if (arg == "--full-digests")
+            opt.full_digests = true;
+        else if (arg == "--explain")
+            opt.explain = true;
+        else if (arg == "--pace" && i+1 < argc) {
+            std::string_view v = argv[++i];
+            double percent = 0;
+            if (std::from_chars(v.data(), v.data()+v.size(), percent).ec != std::errc{} || percent <= 0 || percent > 100) {
+                usage();
+                return 1;
+            }
+            opt.pace = percent / 100;
+        }
+        else if (arg == "--calibrate")
+            calibrate = true;
+        else if (arg == "--threads" && i+1 < argc) {
+            std::string_view v = argv[++i];
+            if (std::from_chars(v.data(), v.data()+v.size(), threads).ec != std::errc{} || threads == 0) {
+                usage();
+                return 1;
+            }
+        }
+        else if (arg == "-h" || arg == "--help") {
+            usage();
             return 0;
         }
+        else if (arg.starts_with("--")) {
+            usage();
+            return 1;
+        }
+        else
+            opt.dir = argv[i];
     }
 
-    try { duplicate_file_search(dir); }
+    if (!opt.since.empty() && !fs::is_regular_file(opt.since) && !parse_time(opt.since))
+    {
+        std::println("Invalid time or index for --since.");
+        return 1;
+    }
+
+    if (!fs::exists(opt.dir) || !fs::is_directory(opt.dir))
+    {
+        std::println("No such directory.");
+        return 0;
+    }
+
+    try {
+        namespace tuning = dfs::tuning;
+        const auto device = tuning::device_id(opt.dir);
+        const auto limits = tuning::read_limits(opt.dir);
+        auto profile = tuning::load();
+
+        if (calibrate) {
+            profile = tuning::calibrate(opt.dir, profile.value_or(tuning::profile{}));
+            tuning::save(*profile);
+            const auto s = tuning::choose(profile, limits, device);
+            std::println("Saved to {}\nThreads: {}+{}, queue depth: {}+{} (small+large files), buffer: {}",
+                         tuning::profile_path().string(), s.small_threads(), s.large_threads,
+                         s.small_queue_depth(), s.large_queue_depth, prettify_bytes(s.bufsize));
+            return 0;
+        }
+
+        opt.tune = tuning::choose(profile, limits, device);
+        opt.profile = profile;
+        if (threads) {
+            opt.tune.threads = threads;
+            tuning::split_lanes(opt.tune);
+        }
+        duplicate_file_search(opt);
+    }
     catch (const fs::filesystem_error& fs_err) {
         std::println(stderr, "Filesystem Exception: {}", fs_err.what());
     }
     catch (const std::exception& e) {
-        std::println(stderr, "Exception: ", e.what());
+        std::println(stderr, "Exception: {}", e.what());
     }
 }
\ No newline at end of file
@@ -0,0 +1,338 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Live counters, gauges and histograms in OpenMetrics text format.
+ *
+ * The metrics are lock-free atomics owned by the program; a registry only
+ * names them. An exporter writes the registry periodically to a file, for
+ * the textfile collector of node_exporter and the like, or serves it on a
+ * Unix socket to every connection, as an HTTP response if asked by GET:
+ *   curl --unix-socket <path> http://localhost/metrics
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace dfs::metrics
+{
+
+class counter
+{
+    std::atomic<std::uint64_t> v_{0};
+public:
+    void add(std::uint64_t n = 1) noexcept { v_.fetch_add(n, std::memory_order_relaxed); }
+    std::uint64_t value() const noexcept { return v_.load(std::memory_order_relaxed); }
+};
+
+class gauge
+{
+    std::atomic<std::int64_t> v_{0};
+public:
+    void set(std::int64_t v) noexcept { v_.store(v, std::memory_order_relaxed); }
+    void add(std::int64_t n = 1) noexcept { v_.fetch_add(n, std::memory_order_relaxed); }
+    void sub(std::int64_t n = 1) noexcept { v_.fetch_sub(n, std::memory_order_relaxed); }
+    std::int64_t value() const noexcept { return v_.load(std::memory_order_relaxed); }
+};
+
+/**
+ * @brief Observations counted into buckets of fixed upper bounds.
+ */
+class histogram
+{
+    std::vector<double> bounds_; // ascending, without +Inf
+    std::unique_ptr<std::atomic<std::uint64_t>[]> buckets_; // not cumulative, the last for +Inf
+    std::atomic<double> sum_{0};
+
+public:
+    explicit histogram(std::vector<double> bounds)
+        : bounds_(std::move(bounds)), buckets_(std::make_unique<std::atomic<std::uint64_t>[]>(bounds_.size()+1))
+    {}
+
+    void observe(double v) noexcept
+    {
+        std::size_t i = 0;
+        while (i < bounds_.size() && v > bounds_[i])
+            i++;
+        buckets_[i].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    const std::vector<double>& bounds() const noexcept { return bounds_; }
+    std::uint64_t bucket(std::size_t i) const noexcept { return buckets_[i].load(std::memory_order_relaxed); }
+    double sum() const noexcept { return sum_.load(std::memory_order_relaxed); }
+};
+
+/**
+ * @brief Escape a label value.
+ */
+inline std::string escape(std::string_view s)
+{
+    std::string out;
+    for (char c: s)
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"':  out += "\\\""; break;
+            case '\n': out += "\\n"; break;
+            default:   out += c;
+        }
+    return out;
+}
+
+/**
+ * @brief Named metrics, grouped into families of one type.
+ *
+ * The metrics must outlive the registry. Families and samples are
+ * added before exporting starts; the values may change at any time.
+ */
+class registry
+{
+    using metric = std::variant<const counter*, const gauge*, const histogram*>;
+    struct family {
+        std::string name, type, help, unit;
+        std::vector<std::pair<std::string, metric>> samples; // labels, as `a="x",b="y"`
+    };
+    std::vector<family> families_;
+
+    family& family_of(std::string_view name, std::string_view type, std::string_view help, std::string_view unit)
+    {
+        for (auto& f: families_)
+            if (f.name == name) {
+                if (f.type != type)
+                    throw std::logic_error("metric family of another type: " + f.name);
+                return f;
+            }
+        return families_.emplace_back(std::string(name), std::string(type), std::string(help), std::string(unit));
+    }
+
+public:
+    /**
+     * @brief Name the counter @p c, in the family @p name, without the
+     *        _total suffix, with @p labels such as `stage="size"`.
+     */
+    void add(std::string_view name, std::string_view help, const counter& c,
+             std::string labels = {}, std::string_view unit = {})
+    {
+        family_of(name, "counter", help, unit).samples.emplace_back(std::move(labels), &c);
+    }
+
+    void add(std::string_view name, std::string_view help, const gauge& g,
+             std::string labels = {}, std::string_view unit = {})
+    {
+        family_of(name, "gauge", help, unit).samples.emplace_back(std::move(labels), &g);
+    }
+
+    void add(std::string_view name, std::string_view help, const histogram& h,
+             std::string labels = {}, std::string_view unit = {})
+    {
+        family_of(name, "histogram", help, unit).samples.emplace_back(std::move(labels), &h);
+    }
+
+    /**
+     * @brief The current values in the OpenMetrics text format.
+     */
+    std::string text() const
+    {
+        std::ostringstream out;
+        auto braces = [](const std::string& labels, std::string_view more = {}) {
+            std::string all = labels;
+            if (!more.empty())
+                all += (all.empty() ? "" : ",") + std::string(more);
+            return all.empty() ? all : '{' + all + '}';
+        };
+        for (const auto& f: families_)
+        {
+            out << std::format("# TYPE {} {}\n", f.name, f.type);
+            if (!f.unit.empty())
+                out << std::format("# UNIT {} {}\n", f.name, f.unit);
+            out << std::format("# HELP {} {}\n", f.name, f.help);
+            for (const auto& [labels, m]: f.samples)
+            {
+                if (auto c = std::get_if<const counter*>(&m))
+                    out << std::format("{}_total{} {}\n", f.name, braces(labels), (*c)->value());
+                else if (auto g = std::get_if<const gauge*>(&m))
+                    out << std::format("{}{} {}\n", f.name, braces(labels), (*g)->value());
+                else {
+                    const auto *h = std::get<const histogram*>(m);
+                    std::uint64_t count = 0;
+                    for (std::size_t i=0; i<=h->bounds().size(); i++) {
+                        count += h->bucket(i);
+                        const auto le = i < h->bounds().size() ? std::format("{}", h->bounds()[i]) : "+Inf";
+                        out << std::format("{}_bucket{} {}\n", f.name, braces(labels, "le=\"" + le + '"'), count);
+                    }
+                    out << std::format("{}_count{} {}\n", f.name, braces(labels), count);
+                    out << std::format("{}_sum{} {}\n", f.name, braces(labels), h->sum());
+                }
+            }
+        }
+        out << "# EOF\n";
+        return out.str();
+    }
+};
+
+/**
+ * @brief Export a registry while alive, to a file or a Unix socket.
+ *
+ * A target "unix:<path>" is a socket created at the path and removed
+ * at the end; any other target is a file, rewritten atomically every
+ * interval and once more at the end.
+ */
+class exporter
+{
+    const registry& reg_;
+    std::string target_;
+    std::chrono::milliseconds interval_;
+#ifndef _WIN32
+    int listener_ = -1;
+#endif
+    std::jthread thread_;
+
+    void write_file() const
+    {
+        const auto tmp = target_ + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios_base::binary | std::ios_base::trunc);
+            out << reg_.text();
+            if (!out)
+                return;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, target_, ec);
+    }
+
+#ifndef _WIN32
+    /**
+     * @brief Remove the socket at @p path, if any, but nothing else.
+     *
+     * @return false if something other than a socket is there.
+     */
+    static bool unlink_socket(const std::string& path)
+    {
+        struct stat st;
+        if (::lstat(path.c_str(), &st) != 0)
+            return errno == ENOENT;
+        return S_ISSOCK(st.st_mode) && ::unlink(path.c_str()) == 0;
+    }
+
+    void serve(std::stop_token stop) const
+    {
+        while (!stop.stop_requested())
+        {
+            pollfd p{listener_, POLLIN, 0};
+            if (::poll(&p, 1, 200) <= 0)
+                continue;
+            const int fd = ::accept(listener_, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+            // An HTTP client sends a request first; a plain reader nothing.
+            std::string request;
+            char buf[1024];
+            pollfd c{fd, POLLIN, 0};
+            while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192 && ::poll(&c, 1, 100) > 0) {
+                const auto n = ::read(fd, buf, sizeof buf);
+                if (n <= 0)
+                    break;
+                request.append(buf, n);
+            }
+            auto body = reg_.text();
+            if (request.starts_with("GET "))
+                body = std::format("HTTP/1.0 200 OK\r\n"
+                                   "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                                   "Content-Length: {}\r\n\r\n", body.size()) + body;
+            for (std::string_view rest = body; !rest.empty(); ) {
+                const auto n = ::send(fd, rest.data(), rest.size(), MSG_NOSIGNAL);
+                if (n <= 0)
+                    break;
+                rest.remove_prefix(n);
+            }
+            ::close(fd);
+        }
+    }
+#endif
+
+public:
+    /**
+     * @throw std::runtime_error if the socket cannot be created.
+     */
+    exporter(const registry& reg, std::string target, std::chrono::milliseconds interval = std::chrono::seconds(5))
+        : reg_(reg), target_(std::move(target)), interval_(interval)
+    {
+        if (target_.starts_with("unix:"))
+        {
+#ifndef _WIN32
+            const auto path = target_.substr(5);
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof addr.sun_path)
+                throw std::runtime_error("Invalid socket path: " + path);
+            path.copy(addr.sun_path, path.size());
+            if (!unlink_socket(path)) // left over by an earlier run
+                throw std::runtime_error("Not a socket, left as it is: " + path);
+            listener_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listener_ < 0 || ::bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0
+                              || ::listen(listener_, 16) != 0)
+            {
+                if (listener_ >= 0)
+                    ::close(listener_);
+                throw std::runtime_error("Cannot listen on: " + path);
+            }
+            thread_ = std::jthread([this](std::stop_token stop) { serve(stop); });
+#else
+            throw std::runtime_error("Unix sockets are not supported here");
+#endif
+        }
+        else
+            thread_ = std::jthread([this](std::stop_token stop) {
+                std::mutex m;
+                std::condition_variable_any cv;
+                std::unique_lock lock(m);
+                while (!stop.stop_requested()) {
+                    write_file();
+                    cv.wait_for(lock, stop, interval_, [] { return false; });
+                }
+            });
+    }
+
+    exporter(const exporter&) = delete;
+    exporter& operator=(const exporter&) = delete;
+
+    ~exporter()
+    {
+        thread_.request_stop();
+        if (thread_.joinable())
+            thread_.join();
+#ifndef _WIN32
+        if (listener_ >= 0) {
+            ::close(listener_);
+            unlink_socket(target_.substr(5));
+            return;
+        }
+#endif
+        write_file();
+    }
+};
+
+} // namespace dfs::metrics
@@ -0,0 +1,132 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Read-only memory mapping of a whole file.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dfs
+{
+
+/**
+ * @brief Map a file read-only into memory for its whole lifetime.
+ *
+ * Pages are loaded lazily by the OS, so opening a large file is cheap
+ * and only the parts actually touched are read from disk.
+ */
+class mapped_file
+{
+    const std::byte *data_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE, mapping_ = nullptr;
+#endif
+
+    void close() noexcept
+    {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+        mapping_ = nullptr;
+#else
+        if (data_ && size_) munmap(const_cast<std::byte*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+public:
+    mapped_file() = default;
+
+    explicit mapped_file(const std::filesystem::path& file)
+    {
+        auto fail = [&](const char *what) {
+            close();
+            throw std::runtime_error(std::string(what) + ": " + file.string());
+        };
+#ifdef _WIN32
+        file_ = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+            fail("Cannot open");
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size))
+            fail("Cannot stat");
+        size_ = static_cast<std::size_t>(size.QuadPart);
+        if (size_ == 0)
+            return;
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_)
+            fail("Cannot map");
+        data_ = static_cast<const std::byte*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (!data_)
+            fail("Cannot map");
+#else
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            fail("Cannot open");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            fail("Cannot stat");
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ != 0) {
+            void *p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                size_ = 0;
+                fail("Cannot map");
+            }
+            data_ = static_cast<const std::byte*>(p);
+        }
+        ::close(fd);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other) noexcept { *this = std::move(other); }
+    mapped_file& operator=(mapped_file&& other) noexcept
+    {
+        if (this != &other) {
+            close();
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+#ifdef _WIN32
+            std::swap(file_, other.file_);
+            std::swap(mapping_, other.mapping_);
+#endif
+        }
+        return *this;
+    }
+
+    ~mapped_file() { close(); }
+
+    const std::byte* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    std::span<const std::byte> bytes() const noexcept { return {data_, size_}; }
+};
+
+} // namespace dfs
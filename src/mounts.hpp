@@ -0,0 +1,269 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Mounted filesystems under a search and how to treat each type.
+ *
+ * The mount table comes from /proc/self/mountinfo, and every mount at or
+ * under the searched directory is identified again by statfs, so that
+ * e.g. nfs4 and nfs share a policy. The policy table says, per type:
+ *   inode_order     stat the entries of a directory in inode order,
+ *                   which follows the inode tables of ext* and XFS
+ *   physical_order  read the files of a group in the order of their
+ *                   first extent, which saves seeks on a spinning disk
+ *   shared_extents  files with the very same shared extents (reflinks)
+ *                   are equal without reading them
+ *   map             hash files straight from a memory mapping
+ *   queue_scale     read this many times the tuned number of files at
+ *                   once, for network filesystems; 0 for no limit
+ * Elsewhere than on Linux there is one mount with the default policy.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <compare>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <linux/magic.h>
+#endif
+
+namespace dfs::mounts
+{
+
+struct policy
+{
+    bool inode_order = false;
+    bool physical_order = false;
+    bool shared_extents = false;
+    bool map = false;
+    unsigned queue_scale = 1;
+};
+
+struct rule
+{
+    std::string_view fstype;
+    policy pol;
+};
+
+inline constexpr rule rules[] {
+    {"ext2",      {.inode_order = true, .physical_order = true}},
+    {"ext3",      {.inode_order = true, .physical_order = true}},
+    {"ext4",      {.inode_order = true, .physical_order = true}},
+    {"xfs",       {.inode_order = true, .physical_order = true, .shared_extents = true}},
+    {"btrfs",     {.physical_order = true, .shared_extents = true}},
+    {"nfs",       {.queue_scale = 4}},
+    {"cifs",      {.queue_scale = 4}},
+    {"smb3",      {.queue_scale = 4}},
+    {"fuse.sshfs",{.queue_scale = 4}},
+    {"tmpfs",     {.map = true, .queue_scale = 0}},
+    {"ramfs",     {.map = true, .queue_scale = 0}},
+};
+
+inline policy policy_for(std::string_view fstype)
+{
+    for (const auto& r: rules)
+        if (r.fstype == fstype)
+            return r.pol;
+    return {};
+}
+
+struct mount
+{
+    std::string path; // absolute, generic; empty for the catch-all
+    std::string fstype;
+    policy pol;
+};
+
+#ifdef __linux__
+namespace detail
+{
+    /**
+     * @brief Undo the octal escapes of spaces and such in mountinfo.
+     */
+    inline std::string unescape(std::string_view s)
+    {
+        std::string out;
+        for (std::size_t i=0; i<s.size(); i++)
+            if (s[i] == '\\' && i+3 < s.size()) {
+                out += static_cast<char>((s[i+1]-'0')*64 + (s[i+2]-'0')*8 + (s[i+3]-'0'));
+                i += 3;
+            }
+            else
+                out += s[i];
+        return out;
+    }
+
+    /**
+     * @brief The canonical type name of the filesystem at @p path, if statfs knows it.
+     */
+    inline std::optional<std::string_view> statfs_type(const std::string& path)
+    {
+        struct statfs st;
+        if (::statfs(path.c_str(), &st) != 0)
+            return std::nullopt;
+        switch (static_cast<unsigned long>(st.f_type)) {
+            case EXT4_SUPER_MAGIC: return "ext4"; // ext2 and ext3 too
+            case XFS_SUPER_MAGIC: return "xfs";
+            case BTRFS_SUPER_MAGIC: return "btrfs";
+            case NFS_SUPER_MAGIC: return "nfs";
+            case 0xFF534D42: return "cifs";
+            case 0xFE534D42: return "smb3";
+            case TMPFS_MAGIC: return "tmpfs";
+            case RAMFS_MAGIC: return "ramfs";
+        }
+        return std::nullopt;
+    }
+
+    inline bool is_under(std::string_view path, std::string_view dir)
+    {
+        return dir.empty() || path == dir
+            || (path.starts_with(dir) && (dir.back() == '/' || path[dir.size()] == '/'));
+    }
+}
+#endif
+
+/**
+ * @brief The mounts that a search of a directory may cross.
+ */
+class table
+{
+    std::vector<mount> mounts_; // innermost first, the catch-all last
+
+public:
+    explicit table([[maybe_unused]] const std::filesystem::path& root)
+    {
+#ifdef __linux__
+        std::error_code ec;
+        const auto dir = std::filesystem::weakly_canonical(std::filesystem::absolute(root, ec), ec).generic_string();
+
+        std::ifstream in("/proc/self/mountinfo");
+        for (std::string line; std::getline(in, line); )
+        {
+            // id parent major:minor root mount-point options [tags...] - type source ...
+            std::istringstream s(line);
+            std::string f[5], tok, type;
+            for (auto& x: f)
+                s >> x;
+            while (s >> tok && tok != "-")
+                ;
+            s >> type;
+            auto path = detail::unescape(f[4]);
+            if (type.empty() || !(detail::is_under(path, dir) || detail::is_under(dir, path)))
+                continue;
+            std::erase_if(mounts_, [&](const mount& m) { return m.path == path; }); // mounted over
+            std::string fstype{detail::statfs_type(path).value_or(type)};
+            mounts_.push_back({path, fstype, policy_for(fstype)});
+        }
+        // Of the mounts above the directory, only the innermost matters.
+        std::ranges::sort(mounts_, std::ranges::greater{}, [](const mount& m) { return m.path.size(); });
+        if (auto it = std::ranges::find_if(mounts_, [&](const mount& m) { return detail::is_under(dir, m.path); });
+            it != mounts_.end())
+        {
+            it->path.clear(); // the catch-all
+            mounts_.erase(it+1, mounts_.end());
+            return;
+        }
+#endif
+        mounts_.push_back({"", "unknown", {}});
+    }
+
+    /**
+     * @brief The index of the mount holding the absolute generic @p path.
+     */
+    std::size_t find([[maybe_unused]] std::string_view path) const
+    {
+#ifdef __linux__
+        for (std::size_t i=0; i+1<mounts_.size(); i++)
+            if (detail::is_under(path, mounts_[i].path))
+                return i;
+#endif
+        return mounts_.size()-1;
+    }
+
+    const mount& operator[](std::size_t i) const { return mounts_[i]; }
+    std::size_t size() const noexcept { return mounts_.size(); }
+    auto begin() const noexcept { return mounts_.begin(); }
+    auto end() const noexcept { return mounts_.end(); }
+};
+
+struct extent
+{
+    std::uint64_t logical, physical, length;
+    auto operator<=>(const extent&) const = default;
+};
+
+/**
+ * @brief The extents of @p file, if they are all known, plainly stored
+ *        and shared with another file.
+ *
+ * Two files of the same size with equal such extents have equal content.
+ */
+inline std::optional<std::vector<extent>> shared_extents([[maybe_unused]] const std::string& file)
+{
+#ifdef __linux__
+    constexpr std::uint32_t max_extents = 1024;
+    constexpr std::uint32_t unplain = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_ENCODED
+                                    | FIEMAP_EXTENT_DATA_ENCRYPTED | FIEMAP_EXTENT_NOT_ALIGNED
+                                    | FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_DATA_TAIL | FIEMAP_EXTENT_UNWRITTEN;
+
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return std::nullopt;
+    std::vector<std::uint64_t> buf((sizeof(fiemap) + max_extents * sizeof(fiemap_extent) + 7) / 8);
+    auto *fm = reinterpret_cast<fiemap*>(buf.data());
+    fm->fm_length = FIEMAP_MAX_OFFSET;
+    fm->fm_extent_count = max_extents;
+    const bool ok = ::ioctl(fd, FS_IOC_FIEMAP, fm) == 0;
+    ::close(fd);
+    if (!ok || fm->fm_mapped_extents == 0 || fm->fm_mapped_extents == max_extents)
+        return std::nullopt;
+
+    std::vector<extent> res;
+    for (std::uint32_t i=0; i<fm->fm_mapped_extents; i++) {
+        const auto& e = fm->fm_extents[i];
+        if ((e.fe_flags & unplain) || !(e.fe_flags & FIEMAP_EXTENT_SHARED))
+            return std::nullopt;
+        res.push_back({e.fe_logical, e.fe_physical, e.fe_length});
+    }
+    return res;
+#else
+    return std::nullopt;
+#endif
+}
+
+/**
+ * @brief Where the first extent of @p file is on the device,
+ *        or 0 if that is not known.
+ */
+inline std::uint64_t physical_offset([[maybe_unused]] const std::string& file)
+{
+#ifdef __linux__
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    std::uint64_t buf[(sizeof(fiemap) + sizeof(fiemap_extent) + 7) / 8] {};
+    auto *fm = reinterpret_cast<fiemap*>(buf);
+    fm->fm_length = FIEMAP_MAX_OFFSET;
+    fm->fm_extent_count = 1;
+    const bool ok = ::ioctl(fd, FS_IOC_FIEMAP, fm) == 0;
+    ::close(fd);
+    if (ok && fm->fm_mapped_extents == 1)
+        return fm->fm_extents[0].fe_physical;
+#endif
+    return 0;
+}
+
+} // namespace dfs::mounts
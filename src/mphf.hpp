@@ -0,0 +1,188 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Minimal perfect hash function over 64-bit key hashes.
+ *
+ * The construction follows BBHash (Limasset et al., 2017):
+ * every level is a bit array of about gamma*n bits, each remaining key
+ * is hashed into it, keys that landed alone set their bit and are done,
+ * colliding keys move on to the next, smaller level.
+ * The index of a key is the rank of its bit over all levels.
+ *
+ * The serialized form is a flat array of 64-bit words,
+ * so it can be queried in place from a memory-mapped file.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "xxhash.hpp"
+
+namespace dfs::mphf
+{
+
+inline constexpr std::size_t max_levels = 32;
+inline constexpr double gamma = 2.0;
+
+/* Word layout:
+ *  [0] number of keys        [1] number of levels
+ *  [2] number of fallbacks   [3] number of bit words
+ *  [4, 4+levels)             words per level
+ *  bit words, one rank sample per 8 bit words,
+ *  then (hash, index) pairs of the fallback keys sorted by hash.
+ */
+inline constexpr std::size_t header_words = 4;
+
+inline std::uint64_t mix(std::uint64_t h, std::uint64_t level) noexcept
+{
+    h += (level + 1) * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+inline std::uint64_t reduce(std::uint64_t h, std::uint64_t n) noexcept
+{
+    return xxh::bit_ops::mul64to128(h, n).high64;
+}
+
+/**
+ * @brief Build the function for @p keys, which should be distinct.
+ *
+ * Duplicate keys can never be separated,
+ * so they end in the fallback list and only one of them is reachable.
+ */
+inline std::vector<std::uint64_t> build(std::vector<std::uint64_t> keys)
+{
+    std::vector<std::uint64_t> level_words, bits;
+    const std::uint64_t nkeys = keys.size();
+
+    while (!keys.empty() && level_words.size() < max_levels)
+    {
+        const std::size_t words = std::max<std::size_t>(1, (std::size_t)(gamma*keys.size() + 63) / 64);
+        const std::size_t nbits = words * 64;
+        const std::uint64_t level = level_words.size();
+        std::vector<std::uint64_t> seen(words), coll(words);
+
+        for (auto k: keys) {
+            auto p = reduce(mix(k, level), nbits);
+            auto& w = seen[p/64];
+            if (w >> (p%64) & 1)
+                coll[p/64] |= 1ull << (p%64);
+            else
+                w |= 1ull << (p%64);
+        }
+
+        std::vector<std::uint64_t> next;
+        for (auto k: keys) {
+            auto p = reduce(mix(k, level), nbits);
+            if (coll[p/64] >> (p%64) & 1)
+                next.push_back(k);
+        }
+        for (std::size_t i=0; i<words; i++)
+            seen[i] &= ~coll[i];
+
+        level_words.push_back(words);
+        bits.insert(bits.end(), seen.begin(), seen.end());
+        keys = std::move(next);
+    }
+
+    std::uint64_t ranked = 0;
+    std::vector<std::uint64_t> out{nkeys, level_words.size(), keys.size(), bits.size()};
+    out.insert(out.end(), level_words.begin(), level_words.end());
+    out.insert(out.end(), bits.begin(), bits.end());
+    for (std::size_t i=0; i<bits.size(); i++) {
+        if (i % 8 == 0)
+            out.push_back(ranked);
+        ranked += std::popcount(bits[i]);
+    }
+
+    std::ranges::sort(keys);
+    for (std::uint64_t i=0; i<keys.size(); i++) {
+        out.push_back(keys[i]);
+        out.push_back(ranked + i);
+    }
+    return out;
+}
+
+/**
+ * @brief Query a serialized function in place.
+ *
+ * For a key of the original set the result is its unique index in [0, n).
+ * Any other key maps to an arbitrary index or to nothing,
+ * so callers must verify the stored key at that index.
+ */
+class view
+{
+    std::span<const std::uint64_t> bits_, ranks_, fallback_;
+    std::array<std::uint64_t, max_levels+1> level_begin_{};
+    std::size_t nlevels_ = 0;
+    std::uint64_t nkeys_ = 0;
+
+public:
+    view() = default;
+
+    explicit view(std::span<const std::uint64_t> words)
+    {
+        auto bad = [] { throw std::runtime_error("Corrupted perfect hash table."); };
+        if (words.size() < header_words)
+            bad();
+        nkeys_ = words[0];
+        nlevels_ = words[1];
+        const auto nfallback = words[2], nbits = words[3];
+        if (nlevels_ > max_levels || words.size() < header_words + nlevels_)
+            bad();
+        for (std::size_t i=0; i<nlevels_; i++)
+            level_begin_[i+1] = level_begin_[i] + words[header_words+i];
+        const auto nranks = (nbits + 7) / 8;
+        if (level_begin_[nlevels_] != nbits
+         || words.size() != header_words + nlevels_ + nbits + nranks + 2*nfallback)
+            bad();
+        words = words.subspan(header_words + nlevels_);
+        bits_ = words.first(nbits);
+        ranks_ = words.subspan(nbits, nranks);
+        fallback_ = words.subspan(nbits + nranks);
+    }
+
+    std::uint64_t size() const noexcept { return nkeys_; }
+
+    std::optional<std::uint64_t> operator()(std::uint64_t key) const noexcept
+    {
+        for (std::size_t level=0; level<nlevels_; level++)
+        {
+            const auto nbits = (level_begin_[level+1] - level_begin_[level]) * 64;
+            const auto p = level_begin_[level]*64 + reduce(mix(key, level), nbits);
+            if (bits_[p/64] >> (p%64) & 1)
+            {
+                auto r = ranks_[p/512];
+                for (auto w = p/512*8; w < p/64; w++)
+                    r += std::popcount(bits_[w]);
+                return r + std::popcount(bits_[p/64] & ((1ull << (p%64)) - 1));
+            }
+        }
+
+        std::size_t lo = 0, hi = fallback_.size() / 2;
+        while (lo < hi) {
+            auto mid = (lo + hi) / 2;
+            if (fallback_[2*mid] < key)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < fallback_.size()/2 && fallback_[2*lo] == key)
+            return fallback_[2*lo + 1];
+        return std::nullopt;
+    }
+};
+
+} // namespace dfs::mphf
@@ -0,0 +1,187 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Choose how to compare the files of a size group by predicted cost.
+ *
+ * The strategies are:
+ *   cached  every digest is known from the cache or an earlier index
+ *   direct  two files are read in step and compared, up to a difference,
+ *           when no digest is wanted
+ *   full    every file is hashed whole
+ *   staged  files are screened by their first and last bytes, and only
+ *           those that share them with another are hashed whole
+ *   blocks  files are hashed block by block against the cached block
+ *           digests of the known ones, up to where they match none
+ *
+ * A file costs the time to open it and reach its data, then its bytes at
+ * the read rate of its device and, if hashed, at the hash rate of a core.
+ * Both rates come from the tuning profile when calibrated, and otherwise
+ * from the class of the device: memory, solid-state, rotational or
+ * network. A share of the files is assumed to survive each screening.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mounts.hpp"
+#include "tuning.hpp"
+
+namespace dfs::planner
+{
+
+enum class strategy { cached, direct, full, staged, blocks };
+inline constexpr std::size_t strategies = 5;
+inline constexpr std::string_view names[strategies] {"cached", "direct", "full", "staged", "blocks"};
+
+inline std::string_view name(strategy s) { return names[static_cast<std::size_t>(s)]; }
+
+struct device
+{
+    std::string_view kind;
+    double seek;      // seconds to open a file and reach its data
+    double read_rate; // bytes per second
+};
+
+inline constexpr device memory     {"memory",     2e-6, 4e9};
+inline constexpr device solid      {"ssd",        1e-4, 5e8};
+inline constexpr device rotational {"hdd",        8e-3, 1.5e8};
+inline constexpr device network    {"network",    1e-3, 1e8};
+
+/**
+ * @brief What is known of a size group before reading it.
+ */
+struct group
+{
+    std::uint64_t filesize;
+    std::span<const std::size_t> unread; // the mount of every file to read
+    std::size_t known;   // files of known digest
+    bool known_blocks;   // whose block digests are all cached
+    bool digests;        // the digest of every file is wanted
+};
+
+struct plan
+{
+    strategy how;
+    double seconds; // predicted
+    std::array<double, strategies> costs; // of every strategy, infinite if not applicable
+};
+
+class model
+{
+    double hash_rate_ = 5e9; // bytes per second of one core
+    std::vector<device> devices_; // per mount
+
+public:
+    static constexpr double survive = 0.25; // share of files surviving a screening
+    static constexpr std::uint64_t ends_bytes = 256;   // read to screen a file by its ends
+    static constexpr std::uint64_t block_size = 1<<20; // as in the cache
+    std::uint64_t chunk = 1<<15; // read at once when comparing directly
+
+    model() = default;
+
+    /**
+     * @brief The model of the mounts of @p table under @p dir,
+     *        with the rates of @p prof where calibrated.
+     */
+    model(const std::optional<tuning::profile>& prof, const mounts::table& table,
+          const std::filesystem::path& dir, std::uint64_t chunk)
+        : chunk(chunk)
+    {
+        if (prof)
+            hash_rate_ = prof->hash_rate;
+        for (const auto& m: table) {
+            const auto path = m.path.empty() ? dir : std::filesystem::path(m.path);
+            const auto id = tuning::device_id(path);
+            auto d = classify(m, id);
+            if (prof)
+                if (auto it = prof->devices.find(id); it != prof->devices.end() && it->second.read_rate > 0)
+                    d.read_rate = it->second.read_rate;
+            devices_.push_back(d);
+        }
+    }
+
+    /**
+     * @brief The class of the device @p id of the mount @p m.
+     */
+    static device classify(const mounts::mount& m, [[maybe_unused]] const std::string& id)
+    {
+        if (m.pol.map)
+            return memory;
+        if (m.pol.queue_scale > 1)
+            return network;
+#ifdef __linux__
+        // A partition has no queue of its own, its disk has.
+        for (const auto *queue: {"/queue/rotational", "/../queue/rotational"}) {
+            std::ifstream in("/sys/dev/block/" + id + queue);
+            int r;
+            if (in >> r)
+                return r ? rotational : solid;
+        }
+#endif
+        return solid;
+    }
+
+    const device& device_of(std::size_t mount) const
+    {
+        return mount < devices_.size() ? devices_[mount] : solid;
+    }
+
+    double hash_rate() const noexcept { return hash_rate_; }
+
+    /**
+     * @brief The strategy of the least predicted cost for @p g.
+     */
+    plan choose(const group& g) const
+    {
+        constexpr auto never = std::numeric_limits<double>::infinity();
+        const auto s = static_cast<double>(g.filesize);
+        const auto n = g.unread.size();
+        plan p{strategy::full, 0, {}};
+        p.costs.fill(never);
+
+        if (n == 0) {
+            p.how = strategy::cached;
+            p.costs[0] = p.seconds = 0;
+            return p;
+        }
+
+        double full = 0, staged = 0, direct = 0, blocks = 0;
+        for (auto m: g.unread) {
+            const auto& d = device_of(m);
+            const auto whole = d.seek + s / d.read_rate + s / hash_rate_;
+            const auto head = std::min(s, double(block_size)); // read before a mismatch
+            full += whole;
+            staged += d.seek + ends_bytes / d.read_rate + survive * whole;
+            direct += d.seek + (survive * s + (1-survive) * std::min(s, double(chunk))) / d.read_rate;
+            blocks += survive * whole + (1-survive) * (d.seek + head / d.read_rate + head / hash_rate_);
+        }
+
+        auto& c = p.costs;
+        c[static_cast<std::size_t>(strategy::full)] = full;
+        // Files of known digest must be hashed whole to be compared with them,
+        // unless their blocks are cached.
+        if (g.known == 0 && g.filesize > ends_bytes)
+            c[static_cast<std::size_t>(strategy::staged)] = staged;
+        if (g.known == 0 && n == 2 && !g.digests)
+            c[static_cast<std::size_t>(strategy::direct)] = direct;
+        if (g.known > 0 && g.known_blocks && g.filesize > block_size)
+            c[static_cast<std::size_t>(strategy::blocks)] = blocks;
+
+        const auto best = std::ranges::min_element(c) - c.begin();
+        p.how = static_cast<strategy>(best);
+        p.seconds = c[best];
+        return p;
+    }
+};
+
+} // namespace dfs::planner
@@ -0,0 +1,175 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Pace reading by the pressure stall information of Linux.
+ *
+ * The "some" line of /proc/pressure/io and /proc/pressure/cpu, or of the
+ * io.pressure and cpu.pressure files of this process's cgroup if those
+ * are missing, counts the time that any task waited for the resource.
+ * Every interval, the share of it stalled since the last one is compared
+ * with a target: above it, the level of reading halves; well below it,
+ * it grows by one file. The level is how many files may be read at once,
+ * and below one, the share of the time that the one file is read: after
+ * reading for t, it waits t * (1/level - 1).
+ *
+ * Without pressure files, such as elsewhere than on Linux, nothing is paced.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tuning.hpp"
+
+namespace dfs::pressure
+{
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief The total microseconds stalled of the "some" line of @p file.
+ */
+inline std::optional<std::uint64_t> some_total(const fs::path& file)
+{
+    std::ifstream in(file);
+    for (std::string line; std::getline(in, line); )
+        if (line.starts_with("some "))
+            if (auto pos = line.find("total="); pos != std::string::npos)
+                return std::strtoull(line.c_str() + pos + 6, nullptr, 10);
+    return std::nullopt;
+}
+
+/**
+ * @brief The pressure files to watch, system-wide ones first.
+ */
+inline std::vector<fs::path> sources()
+{
+    std::vector<fs::path> files;
+#ifdef __linux__
+    for (const auto *name: {"io", "cpu"})
+        if (fs::path f = fs::path("/proc/pressure") / name; some_total(f))
+            files.push_back(f);
+    if (files.empty())
+        if (auto cg = tuning::detail::cgroup_dir())
+            for (const auto *name: {"io.pressure", "cpu.pressure"})
+                if (fs::path f = *cg / name; some_total(f))
+                    files.push_back(f);
+#endif
+    return files;
+}
+
+class pacer
+{
+    const double max_;
+    const double target_;
+    std::vector<fs::path> files_;
+    std::vector<std::uint64_t> totals_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    unsigned allowed_, active_ = 0;
+    std::atomic<double> level_, pressure_{0};
+    std::jthread thread_;
+
+    void adjust(double pressure)
+    {
+        auto level = level_.load();
+        if (pressure > target_)
+            level = std::max(level / 2, 1.0/32);
+        else if (pressure < target_ / 2)
+            level = level < 1 ? std::min(1.0, level * 2) : std::min(max_, level + 1);
+        level_ = level;
+        pressure_ = pressure;
+        {
+            std::lock_guard lock(mutex_);
+            allowed_ = std::max(1u, static_cast<unsigned>(level));
+        }
+        cv_.notify_all();
+    }
+
+public:
+    /**
+     * @brief Read up to @p max files at once, as long as the stalled share
+     *        of the time stays under @p target, sampled every @p interval.
+     */
+    pacer(unsigned max, double target, std::chrono::milliseconds interval = std::chrono::milliseconds(500))
+        : max_(std::max(1u, max)), target_(target), files_(sources()), allowed_(std::max(1u, max)), level_(max_)
+    {
+        for (const auto& f: files_)
+            totals_.push_back(some_total(f).value_or(0));
+        if (files_.empty())
+            return;
+        thread_ = std::jthread([this, interval](std::stop_token stop) {
+            std::mutex m;
+            std::condition_variable_any cv;
+            std::unique_lock lock(m);
+            auto last = std::chrono::steady_clock::now();
+            while (!cv.wait_for(lock, stop, interval, [] { return false; }) && !stop.stop_requested()) {
+                const auto now = std::chrono::steady_clock::now();
+                const auto us = std::chrono::duration<double, std::micro>(now - last).count();
+                last = now;
+                double pressure = 0;
+                for (std::size_t i=0; i<files_.size(); i++)
+                    if (auto total = some_total(files_[i])) {
+                        pressure = std::max(pressure, (*total - totals_[i]) / us);
+                        totals_[i] = *total;
+                    }
+                adjust(pressure);
+            }
+        });
+    }
+
+    pacer(const pacer&) = delete;
+    pacer& operator=(const pacer&) = delete;
+
+    bool active() const noexcept { return !files_.empty(); }
+    double level() const noexcept { return level_.load(std::memory_order_relaxed); }
+    double pressure() const noexcept { return pressure_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Wait until another file may be read.
+     */
+    void acquire()
+    {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [&] { return active_ < allowed_; });
+        active_++;
+    }
+
+    void release()
+    {
+        {
+            std::lock_guard lock(mutex_);
+            active_--;
+        }
+        cv_.notify_one();
+    }
+
+    /**
+     * @brief Wait as long as the level asks for after reading since @p since.
+     *
+     * @return the time reading may go on from.
+     */
+    std::chrono::steady_clock::time_point throttle(std::chrono::steady_clock::time_point since) const
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (const auto level = this->level(); level < 1) {
+            std::this_thread::sleep_for((now - since) * (1/level - 1));
+            now = std::chrono::steady_clock::now();
+        }
+        return now;
+    }
+};
+
+} // namespace dfs::pressure
@@ -0,0 +1,37 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief USDT probes of the provider "dfsearch", for bpftrace and the like.
+ *
+ * A probe is a single nop in the code and a note in the ELF file, which
+ * a tracer turns into a breakpoint when it attaches; the arguments are
+ * only the integers and pointers already at hand. They are compiled in
+ * on Linux when <sys/sdt.h> (systemtap-sdt-dev) is found, unless
+ * DFS_NO_PROBES is defined, and are no-ops otherwise.
+ *
+ * Probes and their arguments:
+ *   dir_enter(path, entries)
+ *   file_open(path, fd)                      fd < 0 if it failed
+ *   read_start(fd, offset, bytes)            offset -1 if sequential
+ *   read_done(fd, bytes)                     bytes < 0 on an error
+ *   hash_done(path, size, bytes_read, ns)    a file hashed whole
+ *   cache_hit(path, size)                    digest known unread
+ *   cache_miss(path, size)
+ *   cache_resume(path, offset)               hashing goes on from offset
+ *   plan(size, strategy, files)              how a size group is compared
+ *   stage_split(stage, size, files, groups)  after screening by "ends" or "digest"
+ *   group_confirmed(size, files)
+ *
+ * For example, the read latency per size of read:
+ *   bpftrace -e 'usdt:./dfsearch:dfsearch:read_start { @t[tid] = nsecs; }
+ *                usdt:./dfsearch:dfsearch:read_done /@t[tid]/ {
+ *                    @us[arg1] = hist((nsecs - @t[tid]) / 1000); delete(@t[tid]); }'
+ */
+
+#pragma once
+
+#if defined(__linux__) && !defined(DFS_NO_PROBES) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define DFS_PROBE(name, ...) STAP_PROBEV(dfsearch, name __VA_OPT__(,) __VA_ARGS__)
+#else
+#define DFS_PROBE(name, ...) do {} while (0)
+#endif
@@ -0,0 +1,332 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Answer questions from an index written by `dfsearch --index`,
+ *        without touching the searched files.
+ *
+ * Usage:
+dfquery <index> path <path>...      duplicates of each path
+dfquery <index> digest <hex>...     files having each digest
+dfquery <index> groups              all duplicate groups
+dfquery <index> info                counts of the index
+dfquery <old> diff <new>            contents and paths that differ
+dfquery <index> merge <index>...    duplicate groups across all indices
+dfquery <index> sketch <file>       write the sketch of the index's contents
+dfquery <sketch> overlap <sketch>...  estimated bytes shared by all sketches
+
+Diff and merge walk the files sections of the indices side by side,
+in their (size, digest) order, like a merge join. Only files with a
+digest take part; `dfsearch --full-digests` gives every file one.
+
+A sketch, from `dfsearch --sketch` or the sketch command, is a fixed-size
+sample of the distinct contents of a host; overlap estimates the bytes of
+the contents every one of the given hosts has (see sketch.hpp).
+ */
+
+#include <print>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "index.hpp"
+#include "sketch.hpp"
+
+namespace fs = std::filesystem;
+
+using dfs::index::reader;
+using dfs::index::file_record;
+
+void print_files(const reader& idx, std::span<const file_record> files)
+{
+    for (const auto& f: files) {
+        auto p = idx.path(f);
+        // This needs to be enforced on Windows.
+        std::vprint_nonunicode("{}\n", std::make_format_args(p));
+    }
+}
+
+int query_path(const reader& idx, std::string_view arg)
+{
+    auto path = dfs::index::normalize_path(fs::path(arg));
+    const auto *f = idx.find_path(path);
+    if (!f) {
+        std::println("{}: not in index", arg);
+        return 1;
+    }
+    if (f->group == dfs::index::no_group) {
+        std::println("{}: no duplicates", arg);
+        return 0;
+    }
+    const auto& g = idx.groups()[f->group];
+    std::println("{}: [{}]  {}", arg, g.count, dfs::index::to_hex(f->digest));
+    print_files(idx, idx.files(g));
+    return 0;
+}
+
+int query_digest(const reader& idx, std::string_view arg)
+{
+    auto digest = dfs::index::from_hex(arg);
+    if (!digest) {
+        std::println(stderr, "Invalid digest: {}", arg);
+        return 1;
+    }
+    auto files = idx.find_digest(*digest);
+    std::println("{}: [{}]", arg, files.size());
+    print_files(idx, files);
+    return files.empty();
+}
+
+/**
+ * @brief The files of @p idx from @p pos on with the content of the first,
+ *        advancing @p pos past them.
+ */
+std::span<const file_record> next_run(const reader& idx, std::size_t& pos)
+{
+    auto files = idx.files();
+    const auto first = pos;
+    while (pos < files.size() && dfs::index::compare_content(files[first], files[pos]) == 0)
+        pos++;
+    return files.subspan(first, pos - first);
+}
+
+bool has_digest(std::span<const file_record> run)
+{
+    return !run.empty() && (run.front().flags & dfs::index::has_digest);
+}
+
+void print_run(const reader& idx, char mark, std::span<const file_record> run)
+{
+    std::println(" {} [{}]  {} B  {}", mark, run.size(), run.front().size, dfs::index::to_hex(run.front().digest));
+    for (const auto& f: run) {
+        auto p = idx.path(f);
+        std::vprint_nonunicode("{} {}\n", std::make_format_args(mark, p));
+    }
+}
+
+/**
+ * @brief Print what differs between @p old_idx and @p new_idx:
+ *        contents only in either, and contents in both but at other paths.
+ *
+ * @return 0 if nothing differs, 1 otherwise.
+ */
+int diff(const reader& old_idx, const reader& new_idx)
+{
+    std::size_t i = 0, j = 0;
+    std::size_t removed = 0, added = 0, moved = 0, same = 0, old_plain = 0, new_plain = 0;
+
+    while (i < old_idx.files().size() || j < new_idx.files().size())
+    {
+        int c;
+        if (i == old_idx.files().size())
+            c = 1;
+        else if (j == new_idx.files().size())
+            c = -1;
+        else
+            c = dfs::index::compare_content(old_idx.files()[i], new_idx.files()[j]);
+
+        auto a = c <= 0 ? next_run(old_idx, i) : std::span<const file_record>{};
+        auto b = c >= 0 ? next_run(new_idx, j) : std::span<const file_record>{};
+        if (!a.empty() && !has_digest(a)) {
+            old_plain += a.size();
+            a = {};
+        }
+        if (!b.empty() && !has_digest(b)) {
+            new_plain += b.size();
+            b = {};
+        }
+
+        if (!a.empty() && b.empty()) {
+            removed++;
+            print_run(old_idx, '-', a);
+        }
+        else if (a.empty() && !b.empty()) {
+            added++;
+            print_run(new_idx, '+', b);
+        }
+        else if (!a.empty())
+        {
+            // Both runs are sorted by path.
+            std::vector<std::pair<char, std::string>> changes;
+            std::size_t x = 0, y = 0;
+            while (x < a.size() || y < b.size()) {
+                auto p = x < a.size() ? old_idx.path(a[x]) : std::string{};
+                auto q = y < b.size() ? new_idx.path(b[y]) : std::string{};
+                if (y == b.size() || (x < a.size() && p < q))
+                    changes.emplace_back('-', std::move(p)), x++;
+                else if (x == a.size() || q < p)
+                    changes.emplace_back('+', std::move(q)), y++;
+                else
+                    x++, y++;
+            }
+            if (changes.empty()) {
+                same++;
+                continue;
+            }
+            moved++;
+            std::println(" * [{} -> {}]  {} B  {}", a.size(), b.size(), a.front().size,
+                         dfs::index::to_hex(a.front().digest));
+            for (const auto& [mark, p]: changes)
+                std::vprint_nonunicode("{} {}\n", std::make_format_args(mark, p));
+        }
+    }
+
+    std::println("\nOnly in old: {}\nOnly in new: {}\nAt other paths: {}\nUnchanged: {}",
+                 removed, added, moved, same);
+    if (old_plain || new_plain)
+        std::println("Without digest, not compared: {} old, {} new files", old_plain, new_plain);
+    return removed || added || moved;
+}
+
+/**
+ * @brief Print the groups of files with equal content across all @p indices.
+ */
+void merge(std::span<const reader> indices, std::span<char *const> names)
+{
+    for (std::size_t k=0; k<indices.size(); k++)
+        std::println("[{}] {}", k+1, names[k]);
+    std::println("");
+
+    std::vector<std::size_t> pos(indices.size());
+    std::vector<std::span<const file_record>> runs(indices.size());
+    std::size_t num = 0, plain = 0;
+    std::uint64_t redundant = 0;
+
+    for (;;)
+    {
+        // The least content not yet passed in any index.
+        const file_record *least = nullptr;
+        for (std::size_t k=0; k<indices.size(); k++)
+            if (pos[k] < indices[k].files().size())
+                if (const auto& f = indices[k].files()[pos[k]]; !least || dfs::index::compare_content(f, *least) < 0)
+                    least = &f;
+        if (!least)
+            break;
+
+        std::size_t count = 0;
+        for (std::size_t k=0; k<indices.size(); k++) {
+            runs[k] = {};
+            if (pos[k] < indices[k].files().size()
+             && dfs::index::compare_content(indices[k].files()[pos[k]], *least) == 0)
+                runs[k] = next_run(indices[k], pos[k]);
+            count += runs[k].size();
+        }
+        if (!(least->flags & dfs::index::has_digest)) {
+            plain += count;
+            continue;
+        }
+        if (count < 2)
+            continue;
+
+        num++;
+        redundant += least->size * (count - 1);
+        std::println(" #{} [{}]  {} B  {}", num, count, least->size, dfs::index::to_hex(least->digest));
+        for (std::size_t k=0; k<indices.size(); k++)
+            for (const auto& f: runs[k]) {
+                auto p = indices[k].path(f);
+                std::vprint_nonunicode("[{}] {}\n", std::make_format_args(k+1, p));
+            }
+        std::println("");
+    }
+
+    std::println("Groups: {}\nRedundant data size: {} B", num, redundant);
+    if (plain)
+        std::println("Without digest, not compared: {} files", plain);
+}
+
+/**
+ * @brief Estimate the contents of each of @p files, of them all,
+ *        and of every one of them.
+ */
+void overlap(std::span<char* const> files)
+{
+    std::vector<dfs::sketch::sketch> sketches;
+    for (const auto *f: files)
+        sketches.push_back(dfs::sketch::sketch::read(f));
+
+    dfs::sketch::sketch all(sketches.front().k());
+    for (std::size_t k=0; k<sketches.size(); k++) {
+        const auto e = sketches[k].total();
+        std::println("[{}] {}: ~{:.0f} B in ~{:.0f} contents", k+1, files[k], e.bytes, e.contents);
+        all.merge(sketches[k]);
+    }
+    const auto u = all.total();
+    const auto s = dfs::sketch::sketch::shared(sketches);
+    std::println("\nUnion:         ~{:.0f} B in ~{:.0f} contents\n"
+                 "Shared by all: ~{:.0f} B in ~{:.0f} contents",
+                 u.bytes, u.contents, s.bytes, s.contents);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        std::println("Usage: dfquery <index> path <path>...\n"
+                     "       dfquery <index> digest <hex>...\n"
+                     "       dfquery <index> groups\n"
+                     "       dfquery <index> info\n"
+                     "       dfquery <old> diff <new>\n"
+                     "       dfquery <index> merge <index>...\n"
+                     "       dfquery <index> sketch <file>\n"
+                     "       dfquery <sketch> overlap <sketch>...");
+        return 1;
+    }
+
+    try {
+        if (std::string_view(argv[2]) == "overlap") {
+            std::vector<char*> files{argv[1]};
+            files.insert(files.end(), argv+3, argv+argc);
+            overlap(files);
+            return 0;
+        }
+
+        reader idx(argv[1]);
+        std::string_view cmd = argv[2];
+        int ret = 0;
+
+        if (cmd == "path")
+            for (int i=3; i<argc; i++)
+                ret |= query_path(idx, argv[i]);
+        else if (cmd == "digest")
+            for (int i=3; i<argc; i++)
+                ret |= query_digest(idx, argv[i]);
+        else if (cmd == "groups") {
+            std::size_t num = 0;
+            for (const auto& g: idx.groups()) {
+                auto files = idx.files(g);
+                std::println(" #{} [{}]  {} B  {}", ++num, g.count, files.front().size,
+                             dfs::index::to_hex(files.front().digest));
+                print_files(idx, files);
+                std::println("");
+            }
+        }
+        else if (cmd == "info")
+            std::println("Files:  {}\nGroups: {}", idx.files().size(), idx.groups().size());
+        else if (cmd == "diff" && argc == 4)
+            ret = diff(idx, reader(argv[3]));
+        else if (cmd == "sketch" && argc == 4) {
+            dfs::sketch::sketch s;
+            for (const auto& f: idx.files())
+                if (f.flags & dfs::index::has_digest)
+                    s.add(f.size, f.digest);
+            s.write(argv[3]);
+        }
+        else if (cmd == "merge") {
+            std::vector<reader> indices;
+            indices.push_back(std::move(idx));
+            for (int i=3; i<argc; i++)
+                indices.emplace_back(argv[i]);
+            std::vector<char*> names{argv[1]};
+            names.insert(names.end(), argv+3, argv+argc);
+            merge(indices, names);
+        }
+        else {
+            std::println(stderr, "Unknown command: {}", cmd);
+            return 1;
+        }
+        return ret;
+    }
+    catch (const std::exception& e) {
+        std::println(stderr, "Exception: {}", e.what());
+        return 1;
+    }
+}
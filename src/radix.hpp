@@ -0,0 +1,190 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Parallel MSD radix sort of strings, such as paths.
+ *
+ * Paths share long prefixes, which a comparison sort compares again and
+ * again. This sort looks at every byte of a key at most a few times: the
+ * prefix shared by all the keys of a range is skipped at once, and the
+ * range is then split by its next byte, in place, into 256 buckets and
+ * one of the keys that end there. Small ranges are left to std::sort,
+ * comparing only what follows the shared prefix, and large buckets are
+ * sorted by a pool of threads.
+ *
+ * Keys are ordered by unsigned bytes, as std::string compares them.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <ranges>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace dfs::radix
+{
+
+namespace detail
+{
+    inline constexpr std::ptrdiff_t small = 64;       // sorted by comparison below this
+    inline constexpr std::ptrdiff_t task_min = 1<<14; // sorted by any thread from this on
+
+    /**
+     * @brief Sort [first, last), whose keys by @p key all share their
+     *        first @p depth bytes, passing every bucket left to sort
+     *        to @p spawn(first, last, depth).
+     */
+    template <class It, class Key, class Spawn>
+    void msd(It first, It last, std::size_t depth, const Key& key, Spawn&& spawn)
+    {
+        const auto n = last - first;
+        if (n < small) {
+            std::sort(first, last, [&](const auto& a, const auto& b) {
+                return key(a).substr(depth) < key(b).substr(depth);
+            });
+            return;
+        }
+
+        // Skip the prefix shared by all the keys.
+        {
+            const std::string_view head = key(*first).substr(depth);
+            std::size_t common = head.size();
+            for (auto it = first+1; it != last && common; ++it) {
+                const auto s = key(*it).substr(depth);
+                common = std::mismatch(head.begin(), head.begin() + std::min(common, s.size()), s.begin()).first
+                       - head.begin();
+            }
+            depth += common;
+        }
+
+        // The byte at depth plus one, 0 where a key ends.
+        thread_local std::vector<std::uint16_t> bytes;
+        bytes.resize(n);
+        std::array<std::size_t, 257> count{}, next;
+        for (std::ptrdiff_t i=0; i<n; i++) {
+            const auto s = key(first[i]);
+            bytes[i] = depth < s.size() ? static_cast<unsigned char>(s[depth]) + 1 : 0;
+            count[bytes[i]]++;
+        }
+        next[0] = 0;
+        for (std::size_t b=1; b<257; b++)
+            next[b] = next[b-1] + count[b-1];
+        const auto start = next;
+
+        // Put every element in its bucket, by cycles of swaps.
+        for (std::size_t b=0; b<257; b++)
+            for (const auto end = start[b] + count[b]; next[b] < end; ) {
+                const auto i = next[b];
+                if (bytes[i] == b) {
+                    next[b]++;
+                    continue;
+                }
+                const auto j = next[bytes[i]]++;
+                std::iter_swap(first+i, first+j);
+                std::swap(bytes[i], bytes[j]);
+            }
+
+        // The keys that end at depth are equal.
+        for (std::size_t b=1; b<257; b++)
+            if (count[b] > 1)
+                spawn(first + start[b], first + start[b] + count[b], depth+1);
+    }
+
+    template <class It, class Key>
+    struct sequential
+    {
+        const Key& key;
+
+        void operator()(It first, It last, std::size_t depth) const
+        {
+            msd(first, last, depth, key, *this);
+        }
+    };
+
+    /**
+     * @brief Threads sorting the large buckets, each as soon as found.
+     */
+    template <class It, class Key>
+    class pool
+    {
+        const Key& key_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::vector<std::tuple<It, It, std::size_t>> tasks_;
+        std::size_t pending_ = 0; // tasks queued or running
+
+        void work()
+        {
+            std::unique_lock lock(mutex_);
+            for (;;) {
+                cv_.wait(lock, [&] { return !tasks_.empty() || pending_ == 0; });
+                if (tasks_.empty())
+                    return;
+                auto [first, last, depth] = tasks_.back();
+                tasks_.pop_back();
+                lock.unlock();
+                msd(first, last, depth, key_, *this);
+                lock.lock();
+                if (--pending_ == 0)
+                    cv_.notify_all();
+            }
+        }
+
+    public:
+        explicit pool(const Key& key) : key_(key) {}
+
+        void operator()(It first, It last, std::size_t depth)
+        {
+            if (last - first < task_min) {
+                msd(first, last, depth, key_, sequential<It, Key>{key_});
+                return;
+            }
+            {
+                std::lock_guard lock(mutex_);
+                tasks_.emplace_back(first, last, depth);
+                pending_++;
+            }
+            cv_.notify_one();
+        }
+
+        void run(It first, It last, unsigned threads)
+        {
+            (*this)(first, last, 0);
+            std::vector<std::jthread> workers;
+            for (unsigned t=1; t<threads; t++)
+                workers.emplace_back([this] { work(); });
+            work();
+        }
+    };
+}
+
+/**
+ * @brief Sort @p r by the strings @p proj gives of its elements,
+ *        which must not be temporaries, on up to @p threads threads,
+ *        or as many as the hardware has if 0.
+ */
+template <std::ranges::random_access_range R, class Proj = std::identity>
+void sort(R&& r, Proj proj = {}, unsigned threads = 0)
+{
+    using It = std::ranges::iterator_t<R>;
+    const auto first = std::ranges::begin(r);
+    const auto last = first + std::ranges::distance(r);
+    const auto key = [&](const auto& e) -> std::string_view { return std::invoke(proj, e); };
+    using Key = decltype(key);
+
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    if (threads == 1 || last - first < 2 * detail::task_min)
+        detail::msd(first, last, 0, key, detail::sequential<It, Key>{key});
+    else
+        detail::pool<It, Key>(key).run(first, last, threads);
+}
+
+} // namespace dfs::radix
@@ -0,0 +1,200 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Fixed-size, mergeable sample of the contents of a search,
+ *        weighted by bytes, to estimate the bytes shared between hosts.
+ *
+ * It is a priority sample: every distinct content, a (size, digest) pair,
+ * gets the pseudo-random u in (0, 1) of its key and the priority size/u,
+ * and the k contents of the highest priorities are kept, with the next
+ * one as the threshold tau. A sampled content of size w stands for
+ * max(w, tau) bytes, which is unbiased for any subset of the contents.
+ * The same content has the same priority on every host, so the sample of
+ * a union is the top k of the samples, and a content of it is on a host
+ * if and only if it is in that host's sample.
+ *
+ * File layout (little-endian): header, then entry[count] by priority.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+#include "xxhash.hpp"
+
+namespace dfs::sketch
+{
+
+static_assert(std::endian::native == std::endian::little, "Sketch files are little-endian.");
+
+inline constexpr char magic[8] {'D','F','S','S','K','E','T','C'};
+inline constexpr std::uint32_t version = 1;
+inline constexpr std::uint32_t default_k = 4096;
+
+struct header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t k;
+    std::uint64_t count;
+};
+
+struct entry {
+    std::uint64_t key; // xxh3-64 of the size and the digest
+    std::uint64_t size;
+
+    double priority() const noexcept
+    {
+        const double u = (static_cast<double>(key >> 11) + 0.5) * 0x1p-53;
+        return static_cast<double>(size) / u;
+    }
+};
+static_assert(sizeof(entry) == 16);
+
+struct estimate {
+    double bytes;    // of distinct contents
+    double contents; // their number
+};
+
+class sketch
+{
+    std::uint32_t k_;
+    std::vector<entry> entries_; // by priority after shrink(), at most k+1
+
+    static bool before(const entry& a, const entry& b) noexcept
+    {
+        const auto pa = a.priority(), pb = b.priority();
+        return pa != pb ? pa > pb : a.key < b.key;
+    }
+
+    void shrink()
+    {
+        std::ranges::sort(entries_, before);
+        auto [first, last] = std::ranges::unique(entries_, {}, &entry::key);
+        entries_.erase(first, last);
+        if (entries_.size() > k_ + std::size_t(1))
+            entries_.resize(k_ + std::size_t(1));
+    }
+
+    /**
+     * @brief The threshold of the sample, 0 if it holds every content.
+     */
+    double tau() const noexcept
+    {
+        return entries_.size() > k_ ? entries_[k_].priority() : 0;
+    }
+
+public:
+    explicit sketch(std::uint32_t k = default_k) : k_(std::max<std::uint32_t>(k, 1)) {}
+
+    std::uint32_t k() const noexcept { return k_; }
+
+    /**
+     * @brief Count a file of @p size bytes with the full-content @p digest.
+     */
+    void add(std::uint64_t size, const xxh::hash128_t& digest)
+    {
+        const std::uint64_t data[3] {size, digest.low64, digest.high64};
+        entries_.push_back({xxh::xxhash3<64>(data, sizeof data), size});
+        if (entries_.size() >= 4 * (k_ + std::size_t(1)))
+            shrink();
+    }
+
+    /**
+     * @brief Add the contents of @p other, with the smaller k of both.
+     */
+    void merge(const sketch& other)
+    {
+        k_ = std::min(k_, other.k_);
+        entries_.insert(entries_.end(), other.entries_.begin(), other.entries_.end());
+        shrink();
+    }
+
+    /**
+     * @brief The bytes and number of the distinct contents.
+     */
+    estimate total()
+    {
+        shrink();
+        const auto t = tau();
+        estimate e{0, 0};
+        for (std::size_t i=0; i<std::min<std::size_t>(k_, entries_.size()); i++) {
+            const auto w = static_cast<double>(entries_[i].size);
+            e.bytes += std::max(w, t);
+            e.contents += std::max(1.0, t / w);
+        }
+        return e;
+    }
+
+    /**
+     * @brief The bytes and number of the distinct contents found in every
+     *        one of @p sketches.
+     */
+    static estimate shared(std::span<sketch> sketches)
+    {
+        if (sketches.empty())
+            return {0, 0};
+        sketch all(sketches[0].k_);
+        std::vector<std::unordered_set<std::uint64_t>> keys;
+        for (auto& s: sketches) {
+            s.shrink();
+            all.merge(s);
+            auto& set = keys.emplace_back();
+            for (const auto& e: s.entries_)
+                set.insert(e.key);
+        }
+        const auto t = all.tau();
+        estimate e{0, 0};
+        for (std::size_t i=0; i<std::min<std::size_t>(all.k_, all.entries_.size()); i++) {
+            const auto& c = all.entries_[i];
+            if (std::ranges::all_of(keys, [&](const auto& set) { return set.contains(c.key); })) {
+                const auto w = static_cast<double>(c.size);
+                e.bytes += std::max(w, t);
+                e.contents += std::max(1.0, t / w);
+            }
+        }
+        return e;
+    }
+
+    void write(const std::filesystem::path& file)
+    {
+        shrink();
+        std::ofstream out(file, std::ios_base::binary | std::ios_base::trunc);
+        header h{};
+        std::memcpy(h.magic, magic, sizeof magic);
+        h.version = version;
+        h.k = k_;
+        h.count = entries_.size();
+        out.write(reinterpret_cast<const char*>(&h), sizeof h);
+        out.write(reinterpret_cast<const char*>(entries_.data()), entries_.size() * sizeof(entry));
+        if (!out)
+            throw std::runtime_error("Cannot write sketch: " + file.string());
+    }
+
+    static sketch read(const std::filesystem::path& file)
+    {
+        std::ifstream in(file, std::ios_base::binary);
+        header h{};
+        if (!in.read(reinterpret_cast<char*>(&h), sizeof h) || std::memcmp(h.magic, magic, sizeof magic) != 0)
+            throw std::runtime_error("Not a sketch file: " + file.string());
+        if (h.version != version)
+            throw std::runtime_error("Unsupported sketch version.");
+        if (h.k == 0 || h.count > h.k + std::uint64_t(1))
+            throw std::runtime_error("Corrupted sketch file.");
+        sketch s(h.k);
+        s.entries_.resize(h.count);
+        if (!in.read(reinterpret_cast<char*>(s.entries_.data()), h.count * sizeof(entry)))
+            throw std::runtime_error("Corrupted sketch file.");
+        s.shrink();
+        return s;
+    }
+};
+
+} // namespace dfs::sketch
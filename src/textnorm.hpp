@@ -0,0 +1,179 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Hash text files as if their line endings and trailing
+ *        whitespace were normalized.
+ *
+ * Normalization drops every run of spaces, tabs and CRs that ends a line
+ * or the file, which turns CRLF into LF and strips trailing whitespace.
+ * Nothing is copied: a SIMD scan finds the line feeds, and every line
+ * goes to the xxh3 state straight from the read buffer, cut before its
+ * trailing whitespace. Only a whitespace run split by a buffer boundary
+ * is held back until it is known whether a line end follows.
+ * A NUL byte marks a file as binary and stops the hashing.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <bit>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DFS_TEXT_SSE2 1
+#endif
+
+#include "xxhash.hpp"
+
+namespace dfs::text
+{
+
+struct normalized
+{
+    std::uint64_t length;   // of the normalized text
+    xxh::hash128_t digest;  // of the normalized text
+    xxh::hash128_t raw;     // of the bytes as stored
+};
+
+class hasher
+{
+    xxh::hash3_state128_t norm_, raw_;
+    std::string pending_; // whitespace not yet known to end a line
+    std::uint64_t length_ = 0;
+
+    static bool is_space(char c) noexcept
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    void emit(const char *p, std::size_t n)
+    {
+        norm_.update(p, n);
+        length_ += n;
+    }
+
+    /**
+     * @brief Take the part [p, p+n) of a line, followed by a line feed at p[n]
+     *        if @p ends_line.
+     */
+    void segment(const char *p, std::size_t n, bool ends_line)
+    {
+        auto q = n;
+        while (q > 0 && is_space(p[q-1]))
+            q--;
+        if (q > 0) {
+            if (!pending_.empty()) {
+                emit(pending_.data(), pending_.size());
+                pending_.clear();
+            }
+            // With nothing trimmed, the line feed goes along in the same update.
+            emit(p, q == n && ends_line ? n+1 : q);
+            if (q == n && ends_line)
+                return;
+        }
+        if (ends_line) {
+            pending_.clear();
+            emit("\n", 1);
+        }
+        else
+            pending_.append(p + q, n - q);
+    }
+
+    /**
+     * @brief Find the next line feed in [p, end), or a NUL byte.
+     *
+     * @return the position found or @p end; @p nul is set if it was a NUL.
+     */
+    static const char* scan(const char *p, const char *end, bool& nul) noexcept
+    {
+#ifdef DFS_TEXT_SSE2
+        const __m128i lf = _mm_set1_epi8('\n'), zero = _mm_setzero_si128();
+        for (; end - p >= 16; p += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, zero)));
+            if (m) {
+                p += std::countr_zero(static_cast<unsigned>(m));
+                nul = *p == '\0';
+                return p;
+            }
+        }
+#endif
+        for (; p < end; p++)
+            if (*p == '\n' || *p == '\0') {
+                nul = *p == '\0';
+                return p;
+            }
+        return end;
+    }
+
+public:
+    hasher() { reset(); }
+
+    void reset()
+    {
+        norm_.reset();
+        raw_.reset();
+        pending_.clear();
+        length_ = 0;
+    }
+
+    /**
+     * @brief Feed the next @p n bytes of the file.
+     *
+     * @return false if they contain a NUL byte.
+     */
+    bool update(const char *p, std::size_t n)
+    {
+        raw_.update(p, n);
+        const char *end = p + n;
+        while (p < end) {
+            bool nul = false;
+            auto lf = scan(p, end, nul);
+            if (nul)
+                return false;
+            segment(p, lf - p, lf != end);
+            p = lf == end ? end : lf + 1;
+        }
+        return true;
+    }
+
+    normalized finish()
+    {
+        pending_.clear(); // whitespace at the end of the file
+        return {length_, norm_.digest(), raw_.digest()};
+    }
+};
+
+/**
+ * @brief Read @p file once and hash it normalized,
+ *        calling @p on_read(n) after reading every n bytes.
+ *
+ * @return nothing if it is not text or cannot be read.
+ */
+template <class OnRead>
+std::optional<normalized> hash_file(const std::string& file, OnRead&& on_read)
+{
+    constexpr std::size_t bufsize {1<<16}; // 64 KiB
+    thread_local auto buf = std::make_unique_for_overwrite<char[]>(bufsize);
+    thread_local hasher h;
+
+    std::ifstream fin(file, std::ios_base::binary);
+    if (!fin)
+        return std::nullopt;
+    h.reset();
+    do {
+        fin.read(buf.get(), bufsize);
+        on_read(static_cast<std::size_t>(fin.gcount()));
+        if (!h.update(buf.get(), fin.gcount()))
+            return std::nullopt;
+    } while (fin);
+    if (!fin.eof())
+        return std::nullopt;
+    return h.finish();
+}
+
+} // namespace dfs::text
@@ -0,0 +1,391 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Concurrency and buffer sizes from a calibration run and cgroup limits.
+ *
+ * `dfsearch --calibrate` measures the hash rate of one core and the read
+ * rate of the device under the searched directory at several queue depths,
+ * then saves them as a profile. Later runs load the profile and derive
+ * their settings from it and from the limits of the current cgroup:
+ *   queue depth  the smallest depth reaching 90% of the best read rate
+ *   threads      enough cores to hash at that read rate, but no fewer
+ *                than the queue depth and no more cores than allowed
+ *   buffer size  larger for faster devices, within the memory limit
+ *
+ * The profile is a text file of "key value..." lines in the user's
+ * configuration directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <print>
+#include <ranges>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#endif
+
+#include "xxhash.hpp"
+
+namespace dfs::tuning
+{
+
+namespace fs = std::filesystem;
+
+struct limits
+{
+    unsigned cpus = 1;
+    std::optional<std::uint64_t> memory;    // bytes
+    std::optional<std::uint64_t> read_bps;  // of the searched device
+};
+
+struct device_profile
+{
+    unsigned queue_depth = 1;
+    double read_rate = 0; // bytes per second at that depth
+};
+
+struct profile
+{
+    double hash_rate = 0; // bytes per second of one core
+    std::map<std::string, device_profile> devices;
+};
+
+struct settings
+{
+    unsigned threads = 1;        // in all
+    unsigned queue_depth = 1;    // in all, per device
+    std::size_t bufsize = 1<<15; // 32 KiB
+
+    // Files from large_min bytes on, whose reads are bound by bandwidth,
+    // are hashed in a lane of their own, so that they neither hold up
+    // the small files, bound by IOPS, nor leave them without threads.
+    std::uint64_t large_min = 1<<20; // 1 MiB
+    unsigned large_threads = 1;
+    unsigned large_queue_depth = 1;
+
+    unsigned small_threads() const { return std::max(1u, threads - std::min(threads, large_threads)); }
+    unsigned small_queue_depth() const { return std::max(1u, queue_depth - std::min(queue_depth, large_queue_depth)); }
+};
+
+/**
+ * @brief Give a quarter of the threads and of the queue depth,
+ *        but at least one of each, to the lane of large files.
+ */
+inline void split_lanes(settings& s)
+{
+    s.large_threads = std::max(1u, s.threads / 4);
+    s.large_queue_depth = std::max(1u, s.queue_depth / 4);
+}
+
+/**
+ * @brief An identifier of the device holding @p p, stable across runs.
+ */
+inline std::string device_id(const fs::path& p)
+{
+#ifdef __linux__
+    struct stat st;
+    if (::stat(p.c_str(), &st) == 0)
+        return std::format("{}:{}", major(st.st_dev), minor(st.st_dev));
+    return "unknown";
+#else
+    std::error_code ec;
+    auto root = fs::absolute(p, ec).root_name().string();
+    return root.empty() ? "default" : root;
+#endif
+}
+
+#ifdef __linux__
+namespace detail
+{
+    inline std::string read_line(const fs::path& file)
+    {
+        std::ifstream in(file);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    /**
+     * @brief The cgroup v2 directory of this process, if mounted.
+     */
+    inline std::optional<fs::path> cgroup_dir()
+    {
+        std::ifstream in("/proc/self/cgroup");
+        for (std::string line; std::getline(in, line); )
+            if (line.starts_with("0::")) {
+                fs::path dir = "/sys/fs/cgroup" + line.substr(3);
+                if (fs::exists(dir / "cgroup.controllers"))
+                    return dir;
+            }
+        return std::nullopt;
+    }
+}
+#endif
+
+/**
+ * @brief The CPUs, memory and read bandwidth this process may use,
+ *        as set by affinity and cgroup (v2, or v1 for the CPU quota).
+ */
+inline limits read_limits([[maybe_unused]] const fs::path& dir)
+{
+    limits lim;
+    lim.cpus = std::max(1u, std::thread::hardware_concurrency());
+
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) == 0)
+        lim.cpus = std::max(1, CPU_COUNT(&set));
+
+    auto quota = [&](double q, double period) {
+        if (q > 0 && period > 0)
+            lim.cpus = std::min(lim.cpus, std::max(1u, (unsigned)std::ceil(q / period)));
+    };
+
+    if (auto cg = detail::cgroup_dir())
+    {
+        // Limits of every ancestor apply as well.
+        for (auto d = *cg; d.string().size() >= std::string_view("/sys/fs/cgroup").size(); d = d.parent_path())
+        {
+            std::istringstream cpu(detail::read_line(d / "cpu.max"));
+            std::string q;
+            double period = 0;
+            if (cpu >> q >> period && q != "max")
+                quota(std::atof(q.c_str()), period);
+
+            auto mem = detail::read_line(d / "memory.max");
+            if (!mem.empty() && mem != "max") {
+                std::uint64_t m = std::strtoull(mem.c_str(), nullptr, 10);
+                lim.memory = std::min(lim.memory.value_or(m), m);
+            }
+
+            std::ifstream io(d / "io.max");
+            const auto dev = device_id(dir);
+            for (std::string line; std::getline(io, line); )
+                if (line.starts_with(dev + " "))
+                    if (auto pos = line.find("rbps="); pos != std::string::npos && line.compare(pos+5, 3, "max"))
+                    {
+                        std::uint64_t r = std::strtoull(line.c_str() + pos + 5, nullptr, 10);
+                        lim.read_bps = std::min(lim.read_bps.value_or(r), r);
+                    }
+
+            if (d == d.parent_path())
+                break;
+        }
+    }
+    else
+    {
+        auto q = detail::read_line("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+        auto p = detail::read_line("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+        if (!q.empty() && !p.empty())
+            quota(std::atof(q.c_str()), std::atof(p.c_str()));
+        auto m = detail::read_line("/sys/fs/cgroup/memory/memory.limit_in_bytes");
+        if (!m.empty() && std::strtoull(m.c_str(), nullptr, 10) < (1ull << 60))
+            lim.memory = std::strtoull(m.c_str(), nullptr, 10);
+    }
+#endif
+    return lim;
+}
+
+inline fs::path profile_path()
+{
+#ifdef _WIN32
+    if (const char *d = std::getenv("APPDATA"))
+        return fs::path(d) / "dfsearch" / "tuning";
+#else
+    if (const char *d = std::getenv("XDG_CONFIG_HOME"); d && *d)
+        return fs::path(d) / "dfsearch" / "tuning";
+    if (const char *d = std::getenv("HOME"))
+        return fs::path(d) / ".config" / "dfsearch" / "tuning";
+#endif
+    return "dfsearch.tuning";
+}
+
+inline std::optional<profile> load(const fs::path& file = profile_path())
+{
+    std::ifstream in(file);
+    if (!in)
+        return std::nullopt;
+
+    profile prof;
+    for (std::string line; std::getline(in, line); )
+    {
+        std::istringstream s(line);
+        std::string key;
+        s >> key;
+        if (key == "hash_rate")
+            s >> prof.hash_rate;
+        else if (key == "device") {
+            std::string id;
+            device_profile d;
+            if (s >> id >> d.queue_depth >> d.read_rate && d.queue_depth > 0)
+                prof.devices[id] = d;
+        }
+    }
+    if (prof.hash_rate <= 0)
+        return std::nullopt;
+    return prof;
+}
+
+inline void save(const profile& prof, const fs::path& file = profile_path())
+{
+    fs::create_directories(file.parent_path());
+    std::ofstream out(file, std::ios_base::trunc);
+    out << "# dfsearch tuning profile, written by --calibrate\n"
+        << std::format("hash_rate {:.0f}\n", prof.hash_rate);
+    for (const auto& [id, d]: prof.devices)
+        out << std::format("device {} {} {:.0f}\n", id, d.queue_depth, d.read_rate);
+    if (!out)
+        throw std::runtime_error("Cannot write tuning profile: " + file.string());
+}
+
+/**
+ * @brief Derive the settings for a search on device @p dev.
+ *
+ * Without a profile, every allowed CPU hashes and reads.
+ */
+inline settings choose(const std::optional<profile>& prof, const limits& lim, const std::string& dev)
+{
+    settings s;
+    s.threads = s.queue_depth = lim.cpus;
+
+    if (prof)
+        if (auto it = prof->devices.find(dev); it != prof->devices.end())
+        {
+            const auto& d = it->second;
+            double rate = d.read_rate;
+            if (lim.read_bps)
+                rate = std::min(rate, double(*lim.read_bps));
+            const auto cores = std::clamp<unsigned>((unsigned)std::ceil(rate / prof->hash_rate), 1, lim.cpus);
+            s.queue_depth = d.queue_depth;
+            s.threads = std::max(d.queue_depth, cores);
+            s.bufsize = rate >= 1e9 ? 1<<20 : rate >= 2e8 ? 1<<18 : 1<<16;
+        }
+
+    if (lim.memory)
+        while (s.bufsize > (1<<15) && s.threads * s.bufsize > *lim.memory / 64)
+            s.bufsize /= 2;
+    split_lanes(s);
+    return s;
+}
+
+namespace detail
+{
+    /**
+     * @brief Read @p file whole, bypassing the page cache where possible.
+     */
+    inline std::uint64_t read_cold(const fs::path& file, char *buf, std::size_t bufsize)
+    {
+        std::uint64_t total = 0;
+#ifdef __linux__
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return 0;
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        for (ssize_t n; (n = ::read(fd, buf, bufsize)) > 0; )
+            total += n;
+        ::close(fd);
+#else
+        std::ifstream fin(file, std::ios_base::binary);
+        do {
+            fin.read(buf, bufsize);
+            total += fin.gcount();
+        } while (fin);
+#endif
+        return total;
+    }
+}
+
+/**
+ * @brief Measure the hash rate and the read rate of the device of @p dir.
+ *
+ * Files of at least 1 MiB under @p dir are read with 1, 2, 4, ... 32
+ * threads at once, each depth on its own share of the files.
+ */
+inline profile calibrate(const fs::path& dir, profile prof = {})
+{
+    using clock = std::chrono::steady_clock;
+    constexpr std::size_t bufsize = 1<<18; // 256 KiB
+    constexpr std::uint64_t min_file = 1<<20;
+    constexpr auto budget = std::chrono::milliseconds(1500);
+
+    {
+        constexpr std::size_t size = 1<<24; // 16 MiB
+        auto data = std::make_unique<char[]>(size);
+        for (std::size_t i=0; i<size; i++)
+            data[i] = static_cast<char>(i * 2654435761u >> 13);
+        std::uint64_t hashed = 0, sink = 0;
+        auto start = clock::now();
+        do {
+            sink ^= xxh::xxhash3<128>(data.get(), size).low64;
+            hashed += size;
+        } while (clock::now() - start < std::chrono::milliseconds(300));
+        prof.hash_rate = hashed / std::chrono::duration<double>(clock::now() - start).count();
+        [[maybe_unused]] volatile std::uint64_t keep = sink; // so the hashing is not dropped
+        std::println("Hash rate:  {:.0f} MB/s per core", prof.hash_rate / 1e6);
+    }
+
+    std::vector<fs::path> files;
+    for (const auto& entry: fs::recursive_directory_iterator{dir, fs::directory_options::skip_permission_denied})
+        if (entry.is_regular_file() && entry.file_size() >= min_file) {
+            files.push_back(entry.path());
+            if (files.size() >= 4096)
+                break;
+        }
+
+    constexpr unsigned depths[] {1, 2, 4, 8, 16, 32};
+    const auto share = files.size() / std::size(depths);
+    if (share < 4) {
+        std::println("Too few files of 1 MiB or more to measure the read rate.");
+        return prof;
+    }
+
+    std::vector<std::pair<unsigned, double>> rates;
+    for (std::size_t k=0; k<std::size(depths); k++)
+    {
+        const auto depth = depths[k];
+        std::atomic<std::size_t> next{k * share};
+        std::atomic<std::uint64_t> bytes{0};
+        const auto end = (k+1) * share;
+        const auto start = clock::now();
+        {
+            std::vector<std::jthread> threads;
+            for (unsigned t=0; t<depth; t++)
+                threads.emplace_back([&] {
+                    auto buf = std::make_unique_for_overwrite<char[]>(bufsize);
+                    for (std::size_t i; clock::now() - start < budget && (i = next++) < end; )
+                        bytes += detail::read_cold(files[i], buf.get(), bufsize);
+                });
+        }
+        double rate = bytes / std::chrono::duration<double>(clock::now() - start).count();
+        rates.emplace_back(depth, rate);
+        std::println("Read rate:  {:.0f} MB/s at queue depth {}", rate / 1e6, depth);
+    }
+
+    const auto best = std::ranges::max(rates | std::views::values);
+    const auto chosen = *std::ranges::find_if(rates, [&](const auto& r) { return r.second >= 0.9 * best; });
+    prof.devices[device_id(dir)] = {chosen.first, chosen.second};
+    return prof;
+}
+
+} // namespace dfs::tuning
@@ -0,0 +1,101 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Walk a directory tree for its regular files and their sizes.
+ *
+ * On Linux every directory is read whole with readdir first, and its
+ * entries are stat-ed relative to the open directory, in inode order on
+ * mounts whose policy asks for it. Elsewhere this is a plain
+ * std::filesystem::recursive_directory_iterator.
+ * Either way, symbolic links to regular files count as files and
+ * symbolic links to directories are not followed.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include "mounts.hpp"
+#include "probes.hpp"
+
+namespace dfs
+{
+
+/**
+ * @brief Call @p on_file(path, size) for every regular file under @p root.
+ *
+ * @throw std::filesystem::filesystem_error if a directory cannot be read.
+ */
+template <class F>
+void walk(const std::filesystem::path& root, [[maybe_unused]] const mounts::table& mounts, F&& on_file)
+{
+    namespace fs = std::filesystem;
+#ifdef __linux__
+    struct item {
+        ino_t ino;
+        unsigned char type;
+        std::string name;
+    };
+    std::vector<fs::path> stack{root};
+    std::vector<item> items;
+
+    while (!stack.empty())
+    {
+        const auto dir = std::move(stack.back());
+        stack.pop_back();
+
+        struct closer { void operator()(DIR *d) const { ::closedir(d); } };
+        std::unique_ptr<DIR, closer> d(::opendir(dir.c_str()));
+        if (!d)
+            throw fs::filesystem_error("cannot open directory", dir, std::error_code(errno, std::generic_category()));
+
+        items.clear();
+        while (const auto *e = ::readdir(d.get()))
+            if (std::string_view name = e->d_name; name != "." && name != "..")
+                items.push_back({e->d_ino, e->d_type, e->d_name});
+        DFS_PROBE(dir_enter, dir.c_str(), items.size());
+
+        std::error_code ec;
+        if (mounts[mounts.find(fs::absolute(dir, ec).generic_string())].pol.inode_order)
+            std::ranges::sort(items, {}, &item::ino);
+
+        const int fd = ::dirfd(d.get());
+        const auto subdirs = stack.size();
+        for (const auto& it: items)
+        {
+            struct stat st;
+            auto type = it.type;
+            if (type == DT_UNKNOWN) {
+                if (::fstatat(fd, it.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0)
+                    continue;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type == DT_DIR)
+                stack.push_back(dir / it.name);
+            else if (type == DT_REG || type == DT_LNK)
+                if (::fstatat(fd, it.name.c_str(), &st, 0) == 0 && S_ISREG(st.st_mode))
+                    on_file(dir / it.name, static_cast<std::uint64_t>(st.st_size));
+        }
+        // Visit the subdirectories in the order they were listed.
+        std::reverse(stack.begin() + subdirs, stack.end());
+    }
+#else
+    for (const auto& entry: fs::recursive_directory_iterator{root})
+        if (entry.is_regular_file())
+            on_file(entry.path(), static_cast<std::uint64_t>(entry.file_size()));
+#endif
+}
+
+} // namespace dfs
@@ -2067,8 +2067,8 @@ namespace xxh
 				bufferedSize = 0;
 			}
 
-			/* consume input by full buffer quantities */
-			if (input + internal_buffer_size <= bEnd) 
+			/* consume input by full buffer quantities, keeping the last one buffered */
+			if (input + internal_buffer_size < bEnd) 
 			{
 				const uint8_t* const limit = bEnd - internal_buffer_size;
 
@@ -2219,6 +2219,62 @@ namespace xxh
 			return update_impl(static_cast<const void*>(input.begin()), input.size() * sizeof(T));
 		}
 
+		/* Stable serialization of a state seeded by reset(seed), so hashing can be
+		 * suspended and resumed later, even by another process.
+		 * Layout, little-endian: u32 magic "X3S1", u32 bit_mode, u64 acc[8], u32 bufferedSize,
+		 * u32 nbStripesSoFar, u64 totalLen, u64 seed, u8 buffer[internal_buffer_size].
+		 * The custom secret is not stored, it is derived from the seed again.
+		 */
+		constexpr static size_t serialized_size = 4 + 4 + 8 * 8 + 4 + 4 + 8 + 8 + internal_buffer_size;
+		constexpr static uint32_t serialized_magic = 0x31533358; /* "X3S1" */
+
+		bool serialize(void* out_) const
+		{
+			if (secret != customSecret)
+			{   /* states using an external secret cannot be restored by seed */
+				return false;
+			}
+
+			uint8_t* out = static_cast<uint8_t*>(out_);
+			mem_ops::writeLE<32>(out, serialized_magic); out += 4;
+			mem_ops::writeLE<32>(out, (uint32_t)bit_mode); out += 4;
+			for (int i = 0; i < 8; i++) { mem_ops::writeLE<64>(out, acc[i]); out += 8; }
+			mem_ops::writeLE<32>(out, bufferedSize); out += 4;
+			mem_ops::writeLE<32>(out, nbStripesSoFar); out += 4;
+			mem_ops::writeLE<64>(out, totalLen); out += 8;
+			mem_ops::writeLE<64>(out, seed); out += 8;
+			memcpy(out, buffer, internal_buffer_size);
+			return true;
+		}
+
+		bool deserialize(const void* in_)
+		{
+			const uint8_t* in = static_cast<const uint8_t*>(in_);
+			if (mem_ops::readLE<32>(in) != serialized_magic || mem_ops::readLE<32>(in + 4) != bit_mode)
+			{
+				return false;
+			}
+
+			const uint8_t* p = in + 8 + 8 * 8;
+			uint32_t const buffered = mem_ops::readLE<32>(p);
+			uint32_t const stripes = mem_ops::readLE<32>(p + 4);
+			uint64_t const length = mem_ops::readLE<64>(p + 8);
+			reset(mem_ops::readLE<64>(p + 16));
+
+			if (stripes >= nbStripesPerBlock || buffered > internal_buffer_size)
+			{
+				reset();
+				return false;
+			}
+
+			for (int i = 0; i < 8; i++) { acc[i] = mem_ops::readLE<64>(in + 8 + 8 * i); }
+			bufferedSize = buffered;
+			nbStripesSoFar = stripes;
+			totalLen = length;
+			memcpy(buffer, p + 24, internal_buffer_size);
+			return true;
+		}
+
 		hash_t<bit_mode> digest()
 		{	
 			if (totalLen > detail3::midsize_max) 
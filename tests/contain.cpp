@@ -0,0 +1,114 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Check that files embedded in larger ones are found where they are.
+ *
+ * Random files of sizes around multiples of the read sizes are put at an
+ * offset inside larger random data, which is scanned as --contained does:
+ * every file must be found at its offset, with the digest of the span
+ * equal to that of the file, and both equal to the one-shot digest.
+ * Windows of periodic data must hash apart by their pattern, and the
+ * rolled hash must be that of the window.
+ */
+
+#include <print>
+#include <cstring>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "contain.hpp"
+
+namespace contain = dfs::contain;
+
+int main()
+{
+    std::vector<std::uint64_t> sizes {contain::window, 8192, 40000};
+    for (std::uint64_t m: {1u<<15, 1u<<16})
+        for (std::uint64_t k: {1u, 2u, 3u, 4u})
+            for (int d: {-1, 0, 1, 256})
+                sizes.push_back(m * k + d);
+    constexpr std::uint64_t offset = 5000;
+
+    std::mt19937_64 rng(3);
+    auto random_bytes = [&](std::size_t n) {
+        std::vector<char> v(n);
+        for (auto& b: v)
+            b = static_cast<char>(rng());
+        return v;
+    };
+
+    int failures = 0;
+    for (const auto size: sizes) {
+        const auto small = random_bytes(size);
+        auto large = random_bytes(offset + size + 3000);
+        std::memcpy(large.data() + offset, small.data(), size);
+
+        auto reader = [](const std::vector<char>& v) {
+            return [&v](char *p, std::size_t n, std::uint64_t at) {
+                if (at + n > v.size())
+                    return false;
+                std::memcpy(p, v.data() + at, n);
+                return true;
+            };
+        };
+        const auto digest = contain::span_digest(reader(small), 0, size);
+        const auto expected = xxh::xxhash3<128>(small.data(), size);
+
+        contain::table table;
+        table.add(contain::hash(reinterpret_cast<const unsigned char*>(small.data())), 0);
+        std::vector<std::uint64_t> found;
+        std::size_t pos = 0;
+        contain::scan([&](char *p, std::size_t n) {
+                n = std::min(n, large.size() - pos);
+                std::memcpy(p, large.data() + pos, n);
+                pos += n;
+                return n;
+            }, table,
+            [&](std::uint64_t at, std::uint32_t) {
+                if (at + size <= large.size() && contain::span_digest(reader(large), at, size) == digest)
+                    found.push_back(at);
+            }, 1<<15);
+
+        if (digest != expected || found != std::vector<std::uint64_t>{offset}) {
+            std::println(stderr, "FAIL size {}: {} offsets found, digest {}", size, found.size(),
+                         digest == expected ? "right" : "wrong");
+            failures++;
+        }
+    }
+
+    // Patterns of periods dividing 64, and a few others.
+    std::set<std::uint64_t> hashes;
+    std::size_t patterns = 0;
+    for (std::size_t period: {1u, 2u, 3u, 4u, 8u, 16u, 32u, 64u, 100u})
+        for (int k=0; k<8; k++, patterns++) {
+            const auto unit = random_bytes(period);
+            std::vector<unsigned char> w(contain::window);
+            for (std::size_t i=0; i<w.size(); i++)
+                w[i] = static_cast<unsigned char>(unit[i % period]);
+            hashes.insert(contain::hash(w.data()));
+        }
+    if (hashes.size() != patterns) {
+        std::println(stderr, "FAIL periodic windows: {} hashes for {} patterns", hashes.size(), patterns);
+        failures++;
+    }
+
+    {
+        const auto data = random_bytes(3 * contain::window);
+        const auto *p = reinterpret_cast<const unsigned char*>(data.data());
+        auto h = contain::hash(p);
+        for (std::size_t i=1; i+contain::window <= data.size(); i++) {
+            h = contain::roll(h, p[i-1], p[i-1+contain::window]);
+            if (h != contain::hash(p + i)) {
+                std::println(stderr, "FAIL rolled hash at {}", i);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    if (failures) {
+        std::println(stderr, "{} failures", failures);
+        return 1;
+    }
+    std::println("{} sizes passed", sizes.size());
+}
@@ -0,0 +1,71 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Check that text differing only in line ends and trailing blanks
+ *        hashes the same when normalized.
+ *
+ * The normalized text reaches xxh3 in pieces cut at line ends and trailing
+ * blanks, which differ between the variants of the same text, so lines
+ * around multiples of the 256-byte xxh3 buffer are tried, with the input
+ * fed in pieces of several sizes too. Every variant must give the digest
+ * and length of the text without CRs and trailing blanks.
+ */
+
+#include <print>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "textnorm.hpp"
+
+int main()
+{
+    std::mt19937_64 rng(5);
+    int failures = 0;
+    std::size_t cases = 0;
+
+    for (std::size_t len: {1u, 15u, 16u, 17u, 255u, 256u, 257u, 511u, 512u, 513u, 1023u, 1024u, 4096u})
+        for (std::size_t lines: {1u, 2u, 3u, 8u}) {
+            std::vector<std::string> text;
+            for (std::size_t i=0; i<lines; i++) {
+                std::string line(len, ' ');
+                for (auto& c: line)
+                    c = static_cast<char>('a' + rng() % 26);
+                // Blanks inside a line are kept, unlike those ending it.
+                if (len > 2)
+                    line[len/2] = rng() % 2 ? ' ' : '\t';
+                text.push_back(std::move(line));
+            }
+
+            std::string clean;
+            for (const auto& line: text)
+                clean += line + '\n';
+            const auto expected = xxh::xxhash3<128>(clean.data(), clean.size());
+
+            const std::string endings[] {"\n", "\r\n", " \n", "\t \r\n", std::string(300, ' ') + "\r\n"};
+            for (std::size_t v=0; v<std::size(endings); v++) {
+                std::string variant;
+                for (std::size_t i=0; i<lines; i++)
+                    variant += text[i] + endings[(v + i) % std::size(endings) * (v > 0)];
+                variant += " \t\r";  // trailing blanks of the file
+
+                for (std::size_t piece: {1u, 7u, 255u, 256u, 257u, 4096u, 1u<<16}) {
+                    dfs::text::hasher h;
+                    for (std::size_t pos = 0; pos < variant.size(); pos += piece)
+                        h.update(variant.data() + pos, std::min(piece, variant.size() - pos));
+                    const auto r = h.finish();
+                    cases++;
+                    if (r.digest != expected || r.length != clean.size()) {
+                        if (failures++ < 20)
+                            std::println(stderr, "FAIL line length {}, {} lines, ending {}, pieces of {}",
+                                         len, lines, v, piece);
+                    }
+                }
+            }
+        }
+
+    if (failures) {
+        std::println(stderr, "{} failures", failures);
+        return 1;
+    }
+    std::println("{} cases passed", cases);
+}
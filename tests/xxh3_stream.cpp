@@ -0,0 +1,104 @@
+/**
+ * @author Cai Heran (Tsai.love.dev@outlook.com)
+ * @brief Check that xxh3 streaming digests do not depend on how the input is cut.
+ *
+ * The digest cache resumes hashing from a serialized state and files are
+ * fed in chunks of whatever size the buffer has, so a digest must be the
+ * one-shot digest of the same bytes whatever the chunks, and whatever the
+ * offset the state was saved and restored at.
+ */
+
+#include <print>
+#include <cstdint>
+#include <array>
+#include <random>
+#include <vector>
+
+#include "xxhash.hpp"
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool ok, std::size_t size, const char *what, std::size_t arg)
+{
+    if (!ok && failures++ < 20)
+        std::println(stderr, "FAIL size {}: {} {}", size, what, arg);
+}
+
+/**
+ * @brief The digest of @p data fed in chunks of sizes drawn by @p next.
+ */
+template <class Next>
+xxh::hash128_t chunked(const std::vector<unsigned char>& data, Next&& next)
+{
+    xxh::hash3_state128_t state;
+    for (std::size_t pos = 0; pos < data.size(); ) {
+        const auto n = std::min(next(), data.size() - pos);
+        state.update(data.data() + pos, n);
+        pos += n;
+    }
+    return state.digest();
+}
+
+} // namespace
+
+int main()
+{
+    std::mt19937_64 rng(1);
+    std::vector<unsigned char> all(1<<21);
+    for (auto& b: all)
+        b = static_cast<unsigned char>(rng());
+
+    // Around multiples of the 256-byte buffer, of a 1 KiB stripe block
+    // and of the usual read sizes, and a few random sizes.
+    std::vector<std::size_t> sizes {0, 1, 16, 128, 129, 240, 241};
+    for (std::size_t m: {256u, 1024u, 4096u, 1u<<15, 1u<<16, 1u<<20})
+        for (std::size_t k: {1u, 2u, 3u})
+            for (int d: {-1, 0, 1})
+                sizes.push_back(m * k + d);
+    sizes.push_back(1048676);
+    sizes.push_back(1114368);
+    for (int i=0; i<8; i++)
+        sizes.push_back(rng() % all.size());
+
+    for (const auto size: sizes) {
+        const std::vector<unsigned char> data(all.begin(), all.begin() + size);
+        const auto expected = xxh::xxhash3<128>(data.data(), data.size());
+
+        for (std::size_t chunk: {1u, 7u, 255u, 256u, 257u, 512u, 4096u, 1u<<15, 1u<<16, 1u<<20})
+            check(chunked(data, [&] { return chunk; }) == expected, size, "chunks of", chunk);
+        for (int i=0; i<4; i++) {
+            std::uniform_int_distribution<std::size_t> pick(1, i < 2 ? 600 : 70000);
+            check(chunked(data, [&] { return pick(rng); }) == expected, size, "random chunks, seed", i);
+        }
+
+        // Save the state at an offset, restore it and go on.
+        std::vector<std::size_t> offsets {0, size};
+        for (std::size_t m: {256u, 1024u, 1u<<15, 1u<<20})
+            for (std::size_t at = m; at < size && offsets.size() < 64; at += m * (1 + at / (m * 8)))
+                for (int d: {-1, 0, 1})
+                    offsets.push_back(at + d);
+        for (int i=0; i<8 && size; i++)
+            offsets.push_back(rng() % size);
+        for (const auto at: offsets) {
+            if (at > size)
+                continue;
+            xxh::hash3_state128_t state;
+            state.update(data.data(), at);
+            std::array<unsigned char, xxh::hash3_state128_t::serialized_size> saved;
+            check(state.serialize(saved.data()), size, "serialize at", at);
+            xxh::hash3_state128_t resumed;
+            check(resumed.deserialize(saved.data()), size, "deserialize at", at);
+            resumed.update(data.data() + at, size - at);
+            check(resumed.digest() == expected, size, "resumed at", at);
+        }
+    }
+
+    if (failures) {
+        std::println(stderr, "{} failures", failures);
+        return 1;
+    }
+    std::println("{} sizes passed", sizes.size());
+}
@@ -3,14 +3,66 @@ set_languages("c++latest")
 
 add_cxflags("/utf-8")
 
+add_requires("zlib", "zstd")
+
 target("dfsearch")
     set_kind("binary")
     set_optimize("fastest")
     set_warnings("more")
     add_files("src/main.cpp")
+    add_packages("zlib", "zstd")
 
 target("fastdfs")
     set_kind("binary")
     set_optimize("fastest")
     set_warnings("more")
     add_files("src/fast.cpp")
+
+target("dfquery")
+    set_kind("binary")
+    set_optimize("fastest")
+    set_warnings("more")
+    add_files("src/query.cpp")
+
+target("bench_dirfd")
+    set_kind("binary")
+    set_default(false)
+    set_optimize("fastest")
+    set_warnings("more")
+    add_includedirs("src")
+    add_files("bench/dirfd.cpp")
+
+target("bench_pathsort")
+    set_kind("binary")
+    set_default(false)
+    set_optimize("fastest")
+    set_warnings("more")
+    add_includedirs("src")
+    add_files("bench/pathsort.cpp")
+
+target("test_xxh3_stream")
+    set_kind("binary")
+    set_default(false)
+    set_optimize("fastest")
+    set_warnings("more")
+    add_includedirs("src")
+    add_files("tests/xxh3_stream.cpp")
+    add_tests("default")
+
+target("test_contain")
+    set_kind("binary")
+    set_default(false)
+    set_optimize("fastest")
+    set_warnings("more")
+    add_includedirs("src")
+    add_files("tests/contain.cpp")
+    add_tests("default")
+
+target("test_textnorm")
+    set_kind("binary")
+    set_default(false)
+    set_optimize("fastest")
+    set_warnings("more")
+    add_includedirs("src")
+    add_files("tests/textnorm.cpp")
+    add_tests("default")